@@ -25,9 +25,24 @@
 
 #include <vector>
 #include <iostream>
+#include <fstream>
 #include <cstdio>
+#include <cstring>
 #include <string>
 #include <cstdint>
+#include <queue>
+#include <thread>
+#include <algorithm>
+#include <cctype>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 std::vector<uint32_t> makePrefixOffline(const std::string & s) {
     std::vector<uint32_t> prefix(s.length());
@@ -69,9 +84,884 @@ void printTemplateOccurrenceOnline(std::string string_template, std::istream & i
     }
 }
 
+// Вывод позиций вхождений: числа форматируются вручную в буфер и сбрасываются в поток
+// большими блоками, вместо operator<< на каждое вхождение.
+class MatchWriter {
+private:
+    static const size_t BUFFER_SIZE = 1 << 16;
+    // максимальная длина записи: 20 цифр uint64_t и разделитель
+    static const size_t MAX_RECORD_LEN = 21;
+
+    std::ostream & output_stream_;
+    std::vector<char> buffer_;
+    size_t used_ = 0;
+
+public:
+    explicit MatchWriter(std::ostream & output_stream) : output_stream_(output_stream), buffer_(BUFFER_SIZE) {}
+    ~MatchWriter() {
+        flush();
+    }
+
+    void write(uint64_t value, char separator) {
+        if (used_ + MAX_RECORD_LEN > BUFFER_SIZE) {
+            flush();
+        }
+
+        char digits[MAX_RECORD_LEN];
+        size_t n_of_digits = 0;
+        do {
+            digits[n_of_digits++] = '0' + value % 10;
+            value /= 10;
+        } while (value > 0);
+
+        while (n_of_digits > 0) {
+            buffer_[used_++] = digits[--n_of_digits];
+        }
+        buffer_[used_++] = separator;
+    }
+
+    void flush() {
+        output_stream_.write(buffer_.data(), used_);
+        used_ = 0;
+    }
+};
+
+// Читает поток блоками по BLOCK_SIZE байт через istream::read и передаёт их в consume(data, size).
+// Состояние автомата между блоками хранит сам consume.
+template<class Consumer>
+void readBlocks(std::istream & input_stream, Consumer consume) {
+    const static size_t BLOCK_SIZE = 1 << 20;
+    std::vector<char> buffer(BLOCK_SIZE);
+
+    while (input_stream) {
+        input_stream.read(buffer.data(), BLOCK_SIZE);
+        size_t size = input_stream.gcount();
+        if (size == 0) {
+            break;
+        }
+        consume(buffer.data(), size);
+    }
+}
+
+// Префильтр для состояния j == 0: ищет в data[from, size) первую позицию s, для которой
+// data[s] == first и data[s + last_offset] == last, то есть совпадают первый и последний символы шаблона.
+// Проверяются только позиции с s + last_offset < size, остальные (хвост блока) возвращаются как есть:
+// вхождение, начинающееся в хвосте, может заканчиваться уже в следующем блоке.
+// Вхождений, начинающихся в пропущенных позициях, быть не может, поэтому поиск с j = 0 с позиции s
+// находит те же вхождения, что и посимвольный проход.
+size_t findCandidate(const char * data, size_t from, size_t size, char first, char last, size_t last_offset) {
+    size_t s = from;
+
+#ifdef __SSE2__
+    // Сравниваем по 16 байт за раз сразу в двух местах и берём позиции, где совпали оба символа
+    const __m128i first_mask = _mm_set1_epi8(first);
+    const __m128i last_mask = _mm_set1_epi8(last);
+    for (; s + last_offset + 16 <= size; s += 16) {
+        __m128i block_first = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + s));
+        __m128i block_last = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + s + last_offset));
+        unsigned mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(block_first, first_mask),
+                                                        _mm_cmpeq_epi8(block_last, last_mask)));
+        if (mask != 0) {
+            return s + __builtin_ctz(mask);
+        }
+    }
+#else
+    while (s + last_offset < size) {
+        auto found = static_cast<const char*>(memchr(data + s, first, size - last_offset - s));
+        if (found == nullptr) {
+            s = size - last_offset;
+            break;
+        }
+        s = found - data;
+        if (data[s + last_offset] == last) {
+            return s;
+        }
+        ++s;
+    }
+#endif
+
+    for (; s + last_offset < size; ++s) {
+        if (data[s] == first && data[s + last_offset] == last) {
+            return s;
+        }
+    }
+    return s;
+}
+
+// Способ перехода автомата по очередному символу
+enum class SearchMode {
+    automatic,  // DFA, если таблица помещается в DFA_MEMORY_LIMIT, иначе префикс-функция
+    prefix,     // откаты по префикс-функции template_prefix[j - 1]
+    dfa         // полная таблица переходов состояние x символ
+};
+
+// Скомпилированный шаблон: строка шаблона с '$' на конце и её префикс-функция,
+// а в режиме DFA - ещё и полная таблица переходов.
+// Поиск идёт по блокам памяти, состояние автомата j хранит вызывающий, поэтому блоки
+// можно подавать последовательно (поток) или независимо (куски файла в разных потоках).
+class TemplateMatcher {
+private:
+    static const size_t ALPHABET_SIZE = 256;
+    // Таблица до 4 МБ ещё помещается в кэш L2/L3, и один переход на символ выгоднее откатов
+    static const size_t DFA_MEMORY_LIMIT = 4 << 20;
+
+    std::string string_template_;
+    uint32_t len_;
+    std::vector<uint32_t> template_prefix_;
+
+    // DFA строится над сжатым алфавитом: символы шаблона получают классы 1..k, остальные - класс 0.
+    // dfa_[j * n_of_classes_ + класс] - состояние после символа в состоянии j.
+    uint16_t symbol_class_[ALPHABET_SIZE] = {};
+    size_t n_of_classes_ = 1;
+    std::vector<uint16_t> dfa_;
+
+    void buildDFA();
+
+public:
+    explicit TemplateMatcher(std::string string_template = "", SearchMode mode = SearchMode::automatic);
+
+    uint32_t length() const {
+        return len_;
+    }
+
+    bool usesDFA() const {
+        return !dfa_.empty();
+    }
+
+    // Память, занимаемая скомпилированным шаблоном, в байтах
+    size_t memoryUsage() const {
+        return string_template_.size() + template_prefix_.size() * sizeof(uint32_t) + dfa_.size() * sizeof(uint16_t);
+    }
+
+    // Сохраняет скомпилированный шаблон (шаблон, префикс-функцию и DFA, если он есть) в бинарный файл
+    bool save(const std::string & filename) const;
+    // Загружает шаблон, сохранённый save(), без повторного предподсчёта.
+    // Возвращает false, если файла нет, он повреждён или в нём другой шаблон.
+    bool load(const std::string & filename, const std::string & string_template);
+
+    void printInfo(std::ostream & log_stream) const {
+        log_stream << "Template length: " << len_ << "\n";
+        log_stream << "Mode: " << (usesDFA() ? "DFA" : "prefix function") << "\n";
+        if (usesDFA()) {
+            log_stream << "DFA: " << len_ + 1 << " states x " << n_of_classes_ << " symbol classes\n";
+        }
+        log_stream << "Memory: " << memoryUsage() << " bytes" << std::endl;
+    }
+
+    // Прогоняет автомат по data[0, size), начиная с состояния j, и вызывает on_match(k)
+    // для каждой позиции k, на которой оканчивается вхождение. Пока j == 0, позиции,
+    // с которых не может начаться вхождение, пропускаются префильтром findCandidate.
+    template<class Callback>
+    void search(const char * data, size_t size, uint32_t & j, Callback on_match) const {
+        if (len_ == 0) {
+            return;
+        }
+
+        const char * pattern = string_template_.data();
+        const uint16_t * dfa = dfa_.data();
+
+        for (size_t k = 0; k < size; ++k) {
+            if (j == 0) {
+                k = findCandidate(data, k, size, pattern[0], pattern[len_ - 1], len_ - 1);
+                if (k == size) {
+                    break;
+                }
+            }
+
+            char ch = data[k];
+            if (dfa != nullptr) {
+                // ровно один переход по таблице на символ
+                j = dfa[j * n_of_classes_ + symbol_class_[static_cast<unsigned char>(ch)]];
+            }
+            else {
+                if (j == len_) {
+                    j = template_prefix_[len_ - 1];
+                }
+                while (j > 0 && ch != pattern[j]) {
+                    j = template_prefix_[j - 1];
+                }
+                if (ch == pattern[j]) {
+                    ++j;
+                }
+            }
+
+            if (j == len_) {
+                on_match(k);
+            }
+        }
+    }
+};
+
+const size_t TemplateMatcher::DFA_MEMORY_LIMIT;
+
+TemplateMatcher::TemplateMatcher(std::string string_template, SearchMode mode) : string_template_(std::move(string_template) + '$'),
+        len_(string_template_.length() - 1), template_prefix_(makePrefixOffline(string_template_)) {
+    for (uint32_t i = 0; i < len_; ++i) {
+        auto ch = static_cast<unsigned char>(string_template_[i]);
+        if (symbol_class_[ch] == 0) {
+            symbol_class_[ch] = n_of_classes_++;
+        }
+    }
+
+    // номера состояний 0..len_ должны помещаться в uint16_t
+    bool dfa_possible = len_ > 0 && len_ < UINT16_MAX;
+    size_t dfa_memory = (len_ + 1) * n_of_classes_ * sizeof(uint16_t);
+
+    if (dfa_possible && (mode == SearchMode::dfa || (mode == SearchMode::automatic && dfa_memory <= DFA_MEMORY_LIMIT))) {
+        buildDFA();
+    }
+}
+
+void TemplateMatcher::buildDFA() {
+    // Строка состояния j совпадает со строкой состояния template_prefix_[j - 1],
+    // кроме перехода по символу шаблона pattern[j], который ведёт в j + 1.
+    // Из конечного состояния len_ переходим так же, как из template_prefix_[len_ - 1].
+    dfa_.assign((len_ + 1) * n_of_classes_, 0);
+
+    for (uint32_t j = 0; j <= len_; ++j) {
+        uint16_t * row = &dfa_[j * n_of_classes_];
+        if (j > 0) {
+            const uint16_t * fallback_row = &dfa_[template_prefix_[j - 1] * n_of_classes_];
+            std::copy(fallback_row, fallback_row + n_of_classes_, row);
+        }
+        if (j < len_) {
+            row[symbol_class_[static_cast<unsigned char>(string_template_[j])]] = j + 1;
+        }
+    }
+}
+
+// То же, что printTemplateOccurrenceOnline (те же позиции и формат вывода), но поток читается блоками,
+// а состояние j переносится через границы блоков.
+void printTemplateOccurrenceBuffered(const TemplateMatcher & matcher, std::istream & input_stream, std::ostream & output_stream) {
+    uint32_t len = matcher.length();
+
+    MatchWriter writer(output_stream);
+
+    uint32_t j = 0;
+    uint64_t i = 0;
+
+    readBlocks(input_stream, [&](const char * data, size_t size) {
+        matcher.search(data, size, j, [&](size_t k) {
+            writer.write(i + k - len, ' ');
+        });
+        i += size;
+    });
+}
+
+// Поиск вхождений с не более чем max_mismatches несовпадающими символами (расстояние Хэмминга)
+// битовым параллелизмом Shift-Or (Bitap). Для каждого d = 0..max_mismatches храним битовую строку R_d:
+// бит i равен 0, если последние i + 1 символов текста совпадают с pattern[0..i] с не более чем d ошибками.
+//   R_0 = (R_0 << 1) | mask[ch]
+//   R_d = ((R_d << 1) | mask[ch]) & (R_{d-1} << 1)   (R_{d-1} - значение до обновления)
+// Шаблоны длиннее 64 символов хранятся в нескольких 64-битных словах с переносом бита между словами.
+// Время O(n * (max_mismatches + 1) * ceil(p / 64)).
+class BitapMatcher {
+private:
+    static const size_t ALPHABET_SIZE = 256;
+    static const size_t WORD_BITS = 64;
+
+    uint32_t len_;
+    size_t max_mismatches_;
+    size_t n_of_words_;
+    // masks_[символ * n_of_words_ + слово]: бит i равен 0, если pattern[i] == символ
+    std::vector<uint64_t> masks_;
+
+public:
+    BitapMatcher(const std::string & string_template, size_t max_mismatches) : len_(string_template.length()),
+            max_mismatches_(max_mismatches), n_of_words_((len_ + WORD_BITS - 1) / WORD_BITS),
+            masks_(ALPHABET_SIZE * n_of_words_, ~uint64_t(0)) {
+        for (uint32_t i = 0; i < len_; ++i) {
+            auto ch = static_cast<unsigned char>(string_template[i]);
+            masks_[ch * n_of_words_ + i / WORD_BITS] &= ~(uint64_t(1) << (i % WORD_BITS));
+        }
+    }
+
+    uint32_t length() const {
+        return len_;
+    }
+
+    // Начальное состояние: ни один префикс ещё не совпал
+    std::vector<uint64_t> initialState() const {
+        return std::vector<uint64_t>((max_mismatches_ + 1) * n_of_words_, ~uint64_t(0));
+    }
+
+    // Прогоняет data[0, size) и вызывает on_match(k) для каждой позиции k, на которой оканчивается вхождение.
+    // state переносится между блоками.
+    template<class Callback>
+    void search(const char * data, size_t size, std::vector<uint64_t> & state, Callback on_match) const {
+        if (len_ == 0) {
+            return;
+        }
+        if (n_of_words_ == 1) {
+            searchSingleWord(data, size, state.data(), on_match);
+        }
+        else {
+            searchMultiWord(data, size, state.data(), on_match);
+        }
+    }
+
+private:
+    template<class Callback>
+    void searchSingleWord(const char * data, size_t size, uint64_t * rows, Callback on_match) const {
+        const uint64_t match_bit = uint64_t(1) << (len_ - 1);
+
+        for (size_t k = 0; k < size; ++k) {
+            uint64_t mask = masks_[static_cast<unsigned char>(data[k])];
+
+            uint64_t previous_old = rows[0];
+            rows[0] = (rows[0] << 1) | mask;
+            for (size_t d = 1; d <= max_mismatches_; ++d) {
+                uint64_t old = rows[d];
+                rows[d] = ((old << 1) | mask) & (previous_old << 1);
+                previous_old = old;
+            }
+
+            if ((rows[max_mismatches_] & match_bit) == 0) {
+                on_match(k);
+            }
+        }
+    }
+
+    template<class Callback>
+    void searchMultiWord(const char * data, size_t size, uint64_t * rows, Callback on_match) const {
+        const size_t match_word = (len_ - 1) / WORD_BITS;
+        const uint64_t match_bit = uint64_t(1) << ((len_ - 1) % WORD_BITS);
+        uint64_t * last_row = rows + max_mismatches_ * n_of_words_;
+
+        // значение строки R_{d-1} до обновления
+        std::vector<uint64_t> previous_old(n_of_words_);
+
+        for (size_t k = 0; k < size; ++k) {
+            const uint64_t * mask = &masks_[static_cast<unsigned char>(data[k]) * n_of_words_];
+
+            for (size_t d = 0; d <= max_mismatches_; ++d) {
+                uint64_t * row = rows + d * n_of_words_;
+                uint64_t carry = 0;
+                uint64_t previous_carry = 0;
+
+                for (size_t w = 0; w < n_of_words_; ++w) {
+                    uint64_t old = row[w];
+                    uint64_t value = (old << 1) | carry | mask[w];
+                    carry = old >> (WORD_BITS - 1);
+
+                    if (d > 0) {
+                        uint64_t previous = previous_old[w];
+                        value &= (previous << 1) | previous_carry;
+                        previous_carry = previous >> (WORD_BITS - 1);
+                    }
+
+                    previous_old[w] = old;
+                    row[w] = value;
+                }
+            }
+
+            if ((last_row[match_word] & match_bit) == 0) {
+                on_match(k);
+            }
+        }
+    }
+};
+
+// Вывод позиций начала вхождений с не более чем max_mismatches ошибками (нумерация с нуля от начала потока).
+// Перевод строки в конце потока к тексту не относится: вхождение, оканчивающееся на нём, не выводится.
+void printTemplateApproximateOccurrence(const std::string & string_template, size_t max_mismatches, std::istream & input_stream, std::ostream & output_stream) {
+    const static uint64_t NONE = UINT64_MAX;
+
+    BitapMatcher matcher(string_template, max_mismatches);
+    uint32_t len = matcher.length();
+    auto state = matcher.initialState();
+
+    MatchWriter writer(output_stream);
+
+    uint64_t i = 0;
+    // Последнее найденное вхождение выводим только после того, как станет известно, что поток не кончился на нём
+    uint64_t pending = NONE;
+    char last_ch = 0;
+
+    readBlocks(input_stream, [&](const char * data, size_t size) {
+        matcher.search(data, size, state, [&](size_t k) {
+            if (pending != NONE) {
+                writer.write(pending, ' ');
+            }
+            pending = i + k + 1 - len;
+        });
+        i += size;
+        last_ch = data[size - 1];
+    });
+
+    if (pending != NONE && !(pending + len == i && last_ch == '\n')) {
+        writer.write(pending, ' ');
+    }
+}
+
+// Файл, отображённый в память только для чтения
+class MappedFile {
+private:
+    const char * data_ = nullptr;
+    size_t size_ = 0;
+
+public:
+    explicit MappedFile(const std::string & filename) {
+        int fd = open(filename.c_str(), O_RDONLY);
+        if (fd < 0) {
+            perror(filename.c_str());
+            return;
+        }
+
+        struct stat file_stat{};
+        if (fstat(fd, &file_stat) == 0 && file_stat.st_size > 0) {
+            void * data = mmap(nullptr, file_stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (data != MAP_FAILED) {
+                data_ = static_cast<const char*>(data);
+                size_ = file_stat.st_size;
+                madvise(data, size_, MADV_SEQUENTIAL);
+            }
+            else {
+                perror(filename.c_str());
+            }
+        }
+        close(fd);
+    }
+    ~MappedFile() {
+        if (data_ != nullptr) {
+            munmap(const_cast<char*>(data_), size_);
+        }
+    }
+    MappedFile(const MappedFile &) = delete;
+    MappedFile & operator=(const MappedFile &) = delete;
+
+    const char * data() const {
+        return data_;
+    }
+    size_t size() const {
+        return size_;
+    }
+};
+
+// Формат файла скомпилированного шаблона (порядок байт - как в памяти машины):
+//   CompiledTemplateHeader,
+//   string_template_ (len + 1 байт, вместе с '$'), дополненный нулями до кратного 4 размера,
+//   template_prefix_ (len + 1 чисел uint32_t),
+//   symbol_class_ (256 чисел uint16_t),
+//   dfa_ (dfa_size чисел uint16_t, 0 - если DFA не построен).
+struct CompiledTemplateHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t len;
+    uint32_t n_of_classes;
+    uint32_t dfa_size;
+};
 
-int main() {
+const char COMPILED_TEMPLATE_MAGIC[4] = {'K', 'M', 'P', 'C'};
+const uint32_t COMPILED_TEMPLATE_VERSION = 1;
+
+size_t alignTo4(size_t size) {
+    return (size + 3) & ~size_t(3);
+}
+
+bool TemplateMatcher::save(const std::string & filename) const {
+    std::ofstream file(filename, std::ios_base::out | std::ios_base::trunc | std::ios_base::binary);
+    if (!file) {
+        perror(filename.c_str());
+        return false;
+    }
+
+    CompiledTemplateHeader header{};
+    memcpy(header.magic, COMPILED_TEMPLATE_MAGIC, sizeof(header.magic));
+    header.version = COMPILED_TEMPLATE_VERSION;
+    header.len = len_;
+    header.n_of_classes = n_of_classes_;
+    header.dfa_size = dfa_.size();
+
+    std::string padded_template = string_template_;
+    padded_template.resize(alignTo4(padded_template.size()), '\0');
+
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.write(padded_template.data(), padded_template.size());
+    file.write(reinterpret_cast<const char*>(template_prefix_.data()), template_prefix_.size() * sizeof(uint32_t));
+    file.write(reinterpret_cast<const char*>(symbol_class_), sizeof(symbol_class_));
+    file.write(reinterpret_cast<const char*>(dfa_.data()), dfa_.size() * sizeof(uint16_t));
+
+    return static_cast<bool>(file);
+}
+
+bool TemplateMatcher::load(const std::string & filename, const std::string & string_template) {
+    // Файла может не быть - это обычный промах кэша, поэтому без perror
+    if (access(filename.c_str(), R_OK) != 0) {
+        return false;
+    }
+
+    MappedFile file(filename);
+    const char * data = file.data();
+    size_t size = file.size();
+
+    CompiledTemplateHeader header{};
+    if (size < sizeof(header)) {
+        return false;
+    }
+    memcpy(&header, data, sizeof(header));
+    if (memcmp(header.magic, COMPILED_TEMPLATE_MAGIC, sizeof(header.magic)) != 0 || header.version != COMPILED_TEMPLATE_VERSION ||
+        header.len != string_template.size() || header.n_of_classes == 0 || header.n_of_classes > ALPHABET_SIZE + 1) {
+        return false;
+    }
+
+    size_t template_offset = sizeof(header);
+    size_t prefix_offset = template_offset + alignTo4(header.len + 1);
+    size_t classes_offset = prefix_offset + (header.len + 1) * sizeof(uint32_t);
+    size_t dfa_offset = classes_offset + sizeof(symbol_class_);
+    if (size != dfa_offset + header.dfa_size * sizeof(uint16_t) ||
+        memcmp(data + template_offset, string_template.data(), header.len) != 0) {
+        return false;
+    }
+
+    // Дальше числа из файла используются как индексы в search, поэтому испорченный или устаревший
+    // кэш отбрасываем целиком: такой файл будет перезаписан, как при несовпадении заголовка
+    if (header.dfa_size != 0 && header.dfa_size != static_cast<uint64_t>(header.len + 1) * header.n_of_classes) {
+        return false;
+    }
+
+    std::vector<uint32_t> template_prefix(header.len + 1);
+    memcpy(template_prefix.data(), data + prefix_offset, template_prefix.size() * sizeof(uint32_t));
+    for (size_t i = 0; i < template_prefix.size(); ++i) {
+        if (template_prefix[i] > i) {
+            return false;
+        }
+    }
+
+    uint16_t symbol_class[ALPHABET_SIZE];
+    memcpy(symbol_class, data + classes_offset, sizeof(symbol_class));
+    for (uint16_t symbol_class_of_ch : symbol_class) {
+        if (symbol_class_of_ch >= header.n_of_classes) {
+            return false;
+        }
+    }
+
+    std::vector<uint16_t> dfa(header.dfa_size);
+    memcpy(dfa.data(), data + dfa_offset, dfa.size() * sizeof(uint16_t));
+    for (uint16_t state : dfa) {
+        if (state > header.len) {
+            return false;
+        }
+    }
+
+    string_template_.assign(data + template_offset, header.len + 1);
+    len_ = header.len;
+    template_prefix_ = std::move(template_prefix);
+    memcpy(symbol_class_, symbol_class, sizeof(symbol_class_));
+    n_of_classes_ = header.n_of_classes;
+    dfa_ = std::move(dfa);
+
+    return true;
+}
+
+// Компилирует шаблон или, если задан cache_filename, берёт уже скомпилированный из кэша.
+// При промахе (нет файла, другой шаблон или режим) компилирует заново и перезаписывает кэш.
+TemplateMatcher compileTemplate(const std::string & string_template, SearchMode mode, const std::string & cache_filename) {
+    if (!cache_filename.empty()) {
+        TemplateMatcher cached;
+        if (cached.load(cache_filename, string_template) &&
+            (mode == SearchMode::automatic || cached.usesDFA() == (mode == SearchMode::dfa))) {
+            return cached;
+        }
+    }
+
+    TemplateMatcher matcher(string_template, mode);
+    if (!cache_filename.empty()) {
+        matcher.save(cache_filename);
+    }
+    return matcher;
+}
+
+// Параллельный поиск по тексту, целиком лежащему в памяти.
+// Текст делится на n_of_threads кусков; кусок c отвечает за вхождения, начинающиеся в [lo_c, hi_c),
+// и поэтому просматривает [lo_c, hi_c + p - 1) - перекрытие со следующим куском на p - 1 символ.
+// Каждое вхождение найдёт ровно один кусок, так что после склейки по порядку кусков дубликатов нет.
+// Возвращает позиции начала вхождений в порядке возрастания.
+std::vector<uint64_t> findTemplateOccurrenceParallel(const TemplateMatcher & matcher, const char * text, size_t size, size_t n_of_threads) {
+    // Слишком мелкие куски не окупают запуск потока
+    const static size_t MIN_CHUNK_SIZE = 1 << 20;
+
+    uint32_t len = matcher.length();
+    n_of_threads = std::max<size_t>(1, std::min(n_of_threads, size / MIN_CHUNK_SIZE));
+    size_t chunk_size = (size + n_of_threads - 1) / n_of_threads;
+
+    std::vector<std::vector<uint64_t>> chunk_matches(n_of_threads);
+    std::vector<std::thread> workers;
+
+    for (size_t c = 0; c < n_of_threads; ++c) {
+        workers.emplace_back([&, c]() {
+            size_t lo = std::min(size, c * chunk_size);
+            size_t hi = std::min(size, lo + chunk_size + (len > 0 ? len - 1 : 0));
+
+            uint32_t j = 0;
+            matcher.search(text + lo, hi - lo, j, [&](size_t k) {
+                chunk_matches[c].push_back(lo + k + 1 - len);
+            });
+        });
+    }
+
+    std::vector<uint64_t> result;
+    for (size_t c = 0; c < n_of_threads; ++c) {
+        workers[c].join();
+        result.insert(result.end(), chunk_matches[c].begin(), chunk_matches[c].end());
+    }
+    return result;
+}
+
+// Читает первое слово текста [begin, end), как std::cin >> string_template, и сдвигает begin за него
+std::string readFirstWord(const char * & begin, const char * end) {
+    while (begin != end && isspace(static_cast<unsigned char>(*begin))) {
+        ++begin;
+    }
+    const char * word_begin = begin;
+    while (begin != end && !isspace(static_cast<unsigned char>(*begin))) {
+        ++begin;
+    }
+    return std::string(word_begin, begin);
+}
+
+// Файловый режим: text - остаток файла после шаблона, обрабатывается в n_of_threads потоков.
+// Вывод совпадает с printTemplateOccurrenceBuffered.
+void printTemplateOccurrenceInText(const TemplateMatcher & matcher, const char * text, size_t size, size_t n_of_threads, std::ostream & output_stream) {
+    auto matches = findTemplateOccurrenceParallel(matcher, text, size, n_of_threads);
+
+    // Текст начинается с перевода строки после шаблона, поэтому позиции в строке на единицу меньше
+    MatchWriter writer(output_stream);
+    for (uint64_t position : matches) {
+        writer.write(position - 1, ' ');
+    }
+}
+
+
+// Автомат Ахо-Корасик: поиск сразу набора шаблонов за один проход по потоку.
+// Время O(n + сумма длин шаблонов + число вхождений).
+//
+// Переходы хранятся в одной плоской таблице transitions_[вершина * n_of_classes_ + класс],
+// а не в map-ах в каждой вершине. Чтобы таблица была компактной, алфавит сжимается:
+// каждому символу, встречающемуся в шаблонах, сопоставляется свой класс, остальным - класс 0.
+class AhoCorasick {
+private:
+    static const size_t ALPHABET_SIZE = 256;
+    static const uint32_t NONE = UINT32_MAX;
+
+    uint16_t symbol_class_[ALPHABET_SIZE] = {};
+    size_t n_of_classes_ = 1;
+
+    std::vector<uint32_t> transitions_;
+    std::vector<uint32_t> suffix_link_;
+    // ближайшая по суффиксным ссылкам вершина, в которой оканчивается какой-то шаблон
+    std::vector<uint32_t> output_link_;
+    // первый шаблон, оканчивающийся в вершине, и следующий шаблон с той же строкой (для повторов в наборе)
+    std::vector<uint32_t> first_pattern_;
+    std::vector<uint32_t> next_pattern_;
+    std::vector<uint32_t> pattern_len_;
+
+    uint32_t addNode();
+    void addPattern(const std::string & pattern, uint32_t id);
+    void buildLinks();
+
+public:
+    explicit AhoCorasick(const std::vector<std::string> & patterns);
+
+    uint32_t next(uint32_t state, unsigned char ch) const {
+        return transitions_[state * n_of_classes_ + symbol_class_[ch]];
+    }
+
+    // Вызывает callback(id шаблона, длина шаблона) для всех шаблонов, оканчивающихся в состоянии state
+    template<class Callback>
+    void forEachMatch(uint32_t state, Callback callback) const {
+        if (first_pattern_[state] == NONE) {
+            state = output_link_[state];
+        }
+        while (state != NONE) {
+            for (uint32_t id = first_pattern_[state]; id != NONE; id = next_pattern_[id]) {
+                callback(id, pattern_len_[id]);
+            }
+            state = output_link_[state];
+        }
+    }
+
+    size_t size() const {
+        return suffix_link_.size();
+    }
+};
+
+const uint32_t AhoCorasick::NONE;
+
+AhoCorasick::AhoCorasick(const std::vector<std::string> & patterns) : next_pattern_(patterns.size(), NONE), pattern_len_(patterns.size()) {
+    // Сжимаем алфавит до символов, встречающихся в шаблонах
+    for (const auto & pattern : patterns) {
+        for (unsigned char ch : pattern) {
+            if (symbol_class_[ch] == 0) {
+                symbol_class_[ch] = n_of_classes_++;
+            }
+        }
+    }
+
+    addNode();
+    for (uint32_t id = 0; id < patterns.size(); ++id) {
+        addPattern(patterns[id], id);
+    }
+    buildLinks();
+}
+
+uint32_t AhoCorasick::addNode() {
+    transitions_.resize(transitions_.size() + n_of_classes_, 0);
+    suffix_link_.push_back(0);
+    output_link_.push_back(NONE);
+    first_pattern_.push_back(NONE);
+    return suffix_link_.size() - 1;
+}
+
+void AhoCorasick::addPattern(const std::string & pattern, uint32_t id) {
+    pattern_len_[id] = pattern.length();
+    // пустой шаблон ни с чем не сопоставляем
+    if (pattern.empty()) {
+        return;
+    }
+
+    uint32_t v = 0;
+    for (unsigned char ch : pattern) {
+        size_t edge = v * n_of_classes_ + symbol_class_[ch];
+        // 0 - корень, а в корень рёбра бора не ведут, поэтому 0 означает отсутствие ребра
+        if (transitions_[edge] == 0) {
+            uint32_t u = addNode();
+            transitions_[edge] = u;
+        }
+        v = transitions_[edge];
+    }
+
+    // шаблоны-повторы складываем в список, сохраняя порядок id
+    uint32_t * last = &first_pattern_[v];
+    while (*last != NONE) {
+        last = &next_pattern_[*last];
+    }
+    *last = id;
+}
+
+void AhoCorasick::buildLinks() {
+    // Обходим бор в ширину: к моменту обработки вершины v строка перехода её суффиксной ссылки
+    // уже достроена до полного автомата, поэтому недостающие переходы v берём оттуда.
+    std::queue<uint32_t> queue;
+    queue.push(0);
+
+    while (!queue.empty()) {
+        uint32_t v = queue.front();
+        queue.pop();
+
+        uint32_t * row = &transitions_[v * n_of_classes_];
+        const uint32_t * link_row = &transitions_[suffix_link_[v] * n_of_classes_];
+
+        for (size_t c = 0; c < n_of_classes_; ++c) {
+            uint32_t u = row[c];
+            if (u != 0) {
+                suffix_link_[u] = v == 0 ? 0 : link_row[c];
+                uint32_t link = suffix_link_[u];
+                output_link_[u] = first_pattern_[link] != NONE ? link : output_link_[link];
+                queue.push(u);
+            }
+            else {
+                row[c] = v == 0 ? 0 : link_row[c];
+            }
+        }
+    }
+}
+
+void printPatternsOccurrenceOnline(const std::vector<std::string> & patterns, std::istream & input_stream, std::ostream & output_stream) {
+    // Выводит пары (номер шаблона, позиция вхождения), по одной на строку
+    AhoCorasick automaton(patterns);
+
+    MatchWriter writer(output_stream);
+
+    uint32_t state = 0;
+    uint64_t i = 0;
+
+    readBlocks(input_stream, [&](const char * data, size_t size) {
+        for (size_t k = 0; k < size; ++k, ++i) {
+            state = automaton.next(state, data[k]);
+            automaton.forEachMatch(state, [&](uint32_t id, uint32_t len) {
+                writer.write(id, ' ');
+                writer.write(i + 1 - len, '\n');
+            });
+        }
+    });
+}
+
+std::vector<std::string> readPatterns(const std::string & filename) {
+    // Шаблоны - по одному на строку, номер шаблона - номер строки (с нуля)
+    std::ifstream file(filename);
+    if (!file) {
+        perror(filename.c_str());
+        return { };
+    }
+
+    std::vector<std::string> patterns;
+    std::string pattern;
+    while (std::getline(file, pattern)) {
+        patterns.push_back(pattern);
+    }
+    return patterns;
+}
+
+
+int main(int argc, char** argv) {
     std::ios::sync_with_stdio(false);
+    std::cin.tie(NULL);
+
+    std::string patterns_filename;
+    std::string input_filename;
+    std::string cache_filename;
+    size_t n_of_threads = std::max(1u, std::thread::hardware_concurrency());
+    SearchMode mode = SearchMode::automatic;
+    bool print_info = false;
+    // -1 - точный поиск
+    long max_mismatches = -1;
+
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (strcmp(argv[i], "-m") == 0) {
+            patterns_filename = argv[i + 1];
+        }
+        else if (strcmp(argv[i], "-f") == 0) {
+            input_filename = argv[i + 1];
+        }
+        else if (strcmp(argv[i], "-j") == 0) {
+            n_of_threads = strtoul(argv[i + 1], nullptr, 10);
+        }
+        else if (strcmp(argv[i], "-c") == 0) {
+            cache_filename = argv[i + 1];
+        }
+        else if (strcmp(argv[i], "-k") == 0) {
+            max_mismatches = strtol(argv[i + 1], nullptr, 10);
+        }
+        else if (strcmp(argv[i], "-d") == 0) {
+            print_info = true;
+            if (strcmp(argv[i + 1], "dfa") == 0) {
+                mode = SearchMode::dfa;
+            }
+            else if (strcmp(argv[i + 1], "prefix") == 0) {
+                mode = SearchMode::prefix;
+            }
+        }
+    }
+
+    if (!patterns_filename.empty()) {
+        // Режим нескольких шаблонов: шаблоны из файла, весь стандартный ввод - текст
+        printPatternsOccurrenceOnline(readPatterns(patterns_filename), std::cin, std::cout);
+        return 0;
+    }
+
+    if (!input_filename.empty()) {
+        MappedFile file(input_filename);
+        const char * text = file.data();
+        const char * end = text + file.size();
+
+        TemplateMatcher matcher = compileTemplate(readFirstWord(text, end), mode, cache_filename);
+        if (print_info) {
+            matcher.printInfo(std::cerr);
+        }
+        printTemplateOccurrenceInText(matcher, text, end - text, n_of_threads, std::cout);
+        return 0;
+    }
 
     std::string string_template;
     std::cin >> string_template;
@@ -79,6 +969,16 @@ int main() {
 //    char temp;
 //    while (std::cin.get(temp) && (temp == ' ' || temp == '\n')) {}
 
-    std::cin.tie(NULL);
-    printTemplateOccurrenceOnline(string_template, std::cin, std::cout);
+    if (max_mismatches >= 0) {
+        // Пропускаем перевод строки после шаблона, чтобы он не попадал в окна поиска с ошибками
+        std::cin.get();
+        printTemplateApproximateOccurrence(string_template, max_mismatches, std::cin, std::cout);
+        return 0;
+    }
+
+    TemplateMatcher matcher = compileTemplate(string_template, mode, cache_filename);
+    if (print_info) {
+        matcher.printInfo(std::cerr);
+    }
+    printTemplateOccurrenceBuffered(matcher, std::cin, std::cout);
 }
\ No newline at end of file
@@ -20,18 +20,28 @@
 #include <iostream>
 #include <string>
 #include <cstdint>
+#include <cstdio>
 #include <vector>
 #include <cassert>
+#include <numeric>
+#include <algorithm>
+#include <utility>
 
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// n_of_palindrom[i] - число палиндромов длины не меньше 2 с центром i:
+// в нечётном режиме центр - символ data[i], в чётном - промежуток между data[i - 1] и data[i]
 template<bool is_even_mode>
-size_t calcPalindroms(const std::string & data) {
+std::vector<ssize_t> calcPalindromRadii(const std::string & data) {
     bool is_uneven_mode = !is_even_mode;
 
     ssize_t n = data.length();
     std::vector<ssize_t> n_of_palindrom(n);
 
     ssize_t l = 0, r = -1;
-    ssize_t result = 0;
 
     for (ssize_t i = 0; i < n; ++i) {
         ssize_t cur_palindrom_len = is_uneven_mode;
@@ -45,7 +55,6 @@ size_t calcPalindroms(const std::string & data) {
         }
 
         n_of_palindrom[i] = cur_palindrom_len - is_uneven_mode;
-        result += n_of_palindrom[i];
 
         if (i + cur_palindrom_len - 1 > r) {
             l = i - cur_palindrom_len + is_uneven_mode;
@@ -53,7 +62,13 @@ size_t calcPalindroms(const std::string & data) {
         }
     }
 
-    return result;
+    return n_of_palindrom;
+}
+
+template<bool is_even_mode>
+size_t calcPalindroms(const std::string & data) {
+    auto n_of_palindrom = calcPalindromRadii<is_even_mode>(data);
+    return std::accumulate(n_of_palindrom.begin(), n_of_palindrom.end(), ssize_t(0));
 }
 
 enum Even{
@@ -61,11 +76,520 @@ enum Even{
     even = 1
 };
 
-int main() {
+// Дерево Фенвика: прибавление в точке и сумма на префиксе за O(log n)
+template<typename T>
+class FenwickTree {
+private:
+    std::vector<T> tree_;
+
+public:
+    explicit FenwickTree(size_t n) : tree_(n + 1) {}
+
+    void add(size_t i, T value) {
+        for (++i; i < tree_.size(); i += i & (~i + 1)) {
+            tree_[i] += value;
+        }
+    }
+
+    // сумма на [0, i)
+    T prefixSum(size_t i) const {
+        T result{};
+        for (; i > 0; i -= i & (~i + 1)) {
+            result += tree_[i];
+        }
+        return result;
+    }
+
+    // сумма на [l, r)
+    T sum(size_t l, size_t r) const {
+        return prefixSum(r) - prefixSum(l);
+    }
+};
+
+// Индекс для запросов "число палиндромов длины не меньше 2 внутри data[l..r]", строится один раз по радиусам Манакера.
+//
+// Палиндром с центром i и радиусом a[i] (a[i] палиндромов с этим центром) целиком лежит в [l, r] на
+// min(a[i], i - l, r - i + e) палиндромов, где e = 0 для нечётных центров и e = 1 для чётных.
+// Для центров левее середины m = (l + r + e) / 2 минимум равен min(a[i], i - l), правее - min(a[i], r - i + e).
+// Слева: если i - a[i] >= l, центр даёт a[i], иначе i - l. Отсекая центры по ключу i - a[i] >= l
+// (оффлайн, запросы по убыванию l), получаем суммы по "активным" центрам из деревьев Фенвика
+// (число, сумма i, сумма a[i]), а вклад остальных - арифметически. Правая половина симметрична
+// с ключом i + a[i] - e <= r и запросами по возрастанию r.
+// Пакет из q запросов обрабатывается за O((n + q) log n).
+class PalindromRangeIndex {
+private:
+    struct Centers {
+        std::vector<int64_t> radius;
+        int64_t e;
+    };
+
+    size_t size_;
+    Centers odd_;
+    Centers even_;
+
+    // Суммы по активным центрам: число центров, сумма их индексов и сумма радиусов.
+    // Храним в одном дереве Фенвика, чтобы все три суммы читались за один проход.
+    struct ActiveSums {
+        int64_t count = 0;
+        int64_t index_sum = 0;
+        int64_t radius_sum = 0;
+
+        ActiveSums() = default;
+        ActiveSums(int64_t count, int64_t index_sum, int64_t radius_sum) : count(count), index_sum(index_sum), radius_sum(radius_sum) {}
+
+        ActiveSums & operator+=(const ActiveSums & other) {
+            count += other.count;
+            index_sum += other.index_sum;
+            radius_sum += other.radius_sum;
+            return *this;
+        }
+        ActiveSums operator-(const ActiveSums & other) const {
+            return {count - other.count, index_sum - other.index_sum, radius_sum - other.radius_sum};
+        }
+    };
+
+    static int64_t arithmeticSum(int64_t l, int64_t r) {
+        // сумма целых на [l, r]
+        return l > r ? 0 : (l + r) * (r - l + 1) / 2;
+    }
+
+    // by_l - номера запросов по убыванию l, by_r - по возрастанию r
+    void addLeftHalves(const Centers & centers, const std::vector<std::pair<size_t, size_t>> & queries,
+                       const std::vector<size_t> & by_l, std::vector<uint64_t> & result) const;
+    void addRightHalves(const Centers & centers, const std::vector<std::pair<size_t, size_t>> & queries,
+                        const std::vector<size_t> & by_r, std::vector<uint64_t> & result) const;
+
+public:
+    explicit PalindromRangeIndex(const std::string & data);
+
+    // Ответы на запросы [l, r] (нумерация с нуля, границы включительно, l <= r < длины строки), в порядке запросов
+    std::vector<uint64_t> count(const std::vector<std::pair<size_t, size_t>> & queries) const;
+};
+
+PalindromRangeIndex::PalindromRangeIndex(const std::string & data) : size_(data.size()) {
+    auto odd_radii = calcPalindromRadii<uneven>(data);
+    auto even_radii = calcPalindromRadii<even>(data);
+    odd_ = Centers{std::vector<int64_t>(odd_radii.begin(), odd_radii.end()), 0};
+    even_ = Centers{std::vector<int64_t>(even_radii.begin(), even_radii.end()), 1};
+}
+
+std::vector<uint64_t> PalindromRangeIndex::count(const std::vector<std::pair<size_t, size_t>> & queries) const {
+    std::vector<size_t> by_l(queries.size());
+    std::iota(by_l.begin(), by_l.end(), 0);
+    std::vector<size_t> by_r = by_l;
+
+    std::sort(by_l.begin(), by_l.end(), [&](size_t x, size_t y) {
+        return queries[x].first > queries[y].first;
+    });
+    std::sort(by_r.begin(), by_r.end(), [&](size_t x, size_t y) {
+        return queries[x].second < queries[y].second;
+    });
+
+    std::vector<uint64_t> result(queries.size(), 0);
+    for (const Centers * centers : {&odd_, &even_}) {
+        addLeftHalves(*centers, queries, by_l, result);
+        addRightHalves(*centers, queries, by_r, result);
+    }
+    return result;
+}
+
+void PalindromRangeIndex::addLeftHalves(const Centers & centers, const std::vector<std::pair<size_t, size_t>> & queries,
+                                        const std::vector<size_t> & by_l, std::vector<uint64_t> & result) const {
+    // центры по убыванию ключа i - a[i]
+    std::vector<size_t> order(size_);
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [&](size_t x, size_t y) {
+        return int64_t(x) - centers.radius[x] > int64_t(y) - centers.radius[y];
+    });
+
+    FenwickTree<ActiveSums> active(size_);
+    size_t next = 0;
+
+    for (size_t q : by_l) {
+        auto l = static_cast<int64_t>(queries[q].first);
+        auto r = static_cast<int64_t>(queries[q].second);
+        int64_t middle = (l + r + centers.e) / 2;
+
+        while (next < size_ && int64_t(order[next]) - centers.radius[order[next]] >= l) {
+            active.add(order[next], ActiveSums(1, order[next], centers.radius[order[next]]));
+            ++next;
+        }
+
+        ActiveSums sums = active.sum(l, middle + 1);
+        int64_t n_of_rest = middle - l + 1 - sums.count;
+        int64_t rest_index_sum = arithmeticSum(l, middle) - sums.index_sum;
+
+        result[q] += sums.radius_sum + rest_index_sum - l * n_of_rest;
+    }
+}
+
+void PalindromRangeIndex::addRightHalves(const Centers & centers, const std::vector<std::pair<size_t, size_t>> & queries,
+                                         const std::vector<size_t> & by_r, std::vector<uint64_t> & result) const {
+    // центры по возрастанию ключа i + a[i] - e
+    std::vector<size_t> order(size_);
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [&](size_t x, size_t y) {
+        return int64_t(x) + centers.radius[x] < int64_t(y) + centers.radius[y];
+    });
+
+    FenwickTree<ActiveSums> active(size_);
+    size_t next = 0;
+
+    for (size_t q : by_r) {
+        auto l = static_cast<int64_t>(queries[q].first);
+        auto r = static_cast<int64_t>(queries[q].second);
+        int64_t middle = (l + r + centers.e) / 2;
+
+        while (next < size_ && int64_t(order[next]) + centers.radius[order[next]] - centers.e <= r) {
+            active.add(order[next], ActiveSums(1, order[next], centers.radius[order[next]]));
+            ++next;
+        }
+
+        ActiveSums sums = active.sum(middle + 1, r + 1);
+        int64_t n_of_rest = r - middle - sums.count;
+        int64_t rest_index_sum = arithmeticSum(middle + 1, r) - sums.index_sum;
+
+        result[q] += sums.radius_sum + (r + centers.e) * n_of_rest - rest_index_sum;
+    }
+}
+
+// Однопроходный алгоритм Манакера сразу для чётных и нечётных палиндромов.
+//
+// Работаем с "прослоенной" строкой t = #s0#s1#...#s(n-1)# длины 2n + 1, не строя её в памяти:
+// центр p нечётный - символ s[(p - 1) / 2], чётный - промежуток между символами.
+// radius[p] - наибольшее k, при котором t[p - k .. p + k] палиндром;
+// палиндромов строки s с центром p ровно (radius[p] + 1) / 2.
+//
+// Радиусы хранятся в uint32_t в кольцевом буфере на window_size последних центров (степень двойки),
+// поэтому память O(window_size), а не O(n). Если зеркальный центр уже вытеснен из буфера
+// (бывает только внутри палиндромов длиннее window_size / 2), радиус считается расширением с нуля:
+// ответ остаётся точным, теряется только линейность на таких строках.
+// Строка должна быть короче 2^31 символов, чтобы радиусы помещались в uint32_t.
+uint64_t countAllPalindroms(const char * data, size_t n, size_t window_size) {
+    assert(n < (size_t(1) << 31) && "radius must fit uint32_t");
+
+    const size_t size = 2 * n + 1;
+    size_t capacity = 1;
+    while (capacity < std::min(size, window_size)) {
+        capacity <<= 1;
+    }
+    const size_t mask = capacity - 1;
+    std::vector<uint32_t> radius(capacity);
+
+    // символ прослоенной строки; все '#' считаем равными друг другу и отличными от символов s
+    auto symbol = [data](size_t q) -> int {
+        return q % 2 == 0 ? -1 : static_cast<unsigned char>(data[q / 2]);
+    };
+
+    uint64_t result = 0;
+    // самый правый найденный палиндром: центр center, правая граница right = center + radius[center]
+    size_t center = 0, right = 0;
+
+    for (size_t p = 0; p < size; ++p) {
+        size_t k = 0;
+        if (p < right) {
+            size_t mirror = 2 * center - p;
+            if (p - mirror < capacity) {
+                k = std::min<size_t>(radius[mirror & mask], right - p);
+            }
+        }
+        while (k < p && p + k + 1 < size && symbol(p - k - 1) == symbol(p + k + 1)) {
+            ++k;
+        }
+
+        radius[p & mask] = k;
+        result += (k + 1) / 2;
+
+        if (p + k > right) {
+            center = p;
+            right = p + k;
+        }
+    }
+
+    // Нам нужны пары i < j, то есть палиндромы длины не меньше 2
+    return result - n;
+}
+
+// Дерево палиндромов (eertree). Строится онлайн: append добавляет символ в конец строки за O(1) амортизированно.
+// Каждая вершина - различный палиндром строки; 0 - воображаемый корень длины -1, 1 - пустой палиндром.
+// suffix_link_[v] - наибольший собственный палиндромный суффикс палиндрома v.
+//
+// Вершины хранятся в параллельных массивах (пул), рёбра - в общем пуле списками:
+// edge_to_/edge_next_/edge_symbol_, first_edge_[v] - голова списка рёбер вершины v.
+// Из вершины выходит в среднем меньше одного ребра, так что это компактнее таблицы на весь алфавит.
+class PalindromicTree {
+private:
+    static const uint32_t NONE = UINT32_MAX;
+
+    std::string text_;
+
+    std::vector<int32_t> len_;
+    std::vector<uint32_t> suffix_link_;
+    std::vector<uint32_t> first_edge_;
+    // позиция, на которой палиндром вершины впервые закончился
+    std::vector<uint32_t> first_end_;
+    // число палиндромных суффиксов палиндрома вершины (глубина по суффиксным ссылкам)
+    std::vector<uint32_t> n_of_suffix_palindroms_;
+    // сколько раз вершина была наибольшим палиндромным суффиксом
+    std::vector<uint64_t> n_of_ends_;
+
+    std::vector<uint32_t> edge_to_;
+    std::vector<uint32_t> edge_next_;
+    std::vector<unsigned char> edge_symbol_;
+
+    // вершина наибольшего палиндромного суффикса текущей строки
+    uint32_t last_ = 1;
+    uint64_t n_of_palindroms_ = 0;
+    // длина наибольшего палиндрома, оканчивающегося в каждой позиции
+    std::vector<uint32_t> longest_ending_at_;
+
+    uint32_t addNode(int32_t len, uint32_t suffix_link, uint32_t end);
+    uint32_t findEdge(uint32_t v, unsigned char symbol) const;
+    uint32_t findExtendable(uint32_t v, size_t i) const;
+
+public:
+    PalindromicTree();
+
+    void append(char ch);
+
+    // Длина строки
+    size_t size() const {
+        return text_.size();
+    }
+    // Число различных непустых палиндромов
+    size_t countDistinct() const {
+        return len_.size() - 2;
+    }
+    // Число палиндромных подстрок с учётом повторений (включая однобуквенные)
+    uint64_t countAll() const {
+        return n_of_palindroms_;
+    }
+    // Длина наибольшего палиндрома, оканчивающегося в позиции i
+    uint32_t longestEndingAt(size_t i) const {
+        return longest_ending_at_[i];
+    }
+
+    // Вызывает callback(начало первого вхождения, длина, число вхождений) для каждого различного палиндрома.
+    // Число вхождений вершины - сумма n_of_ends_ по её поддереву суффиксных ссылок, считаем за O(число вершин).
+    template<class Callback>
+    void forEachPalindrom(Callback callback) const {
+        std::vector<uint64_t> occurrences(n_of_ends_);
+        // суффиксная ссылка всегда ведёт в более раннюю вершину, поэтому идём с конца
+        for (size_t v = len_.size() - 1; v >= 2; --v) {
+            occurrences[suffix_link_[v]] += occurrences[v];
+        }
+        for (size_t v = 2; v < len_.size(); ++v) {
+            callback(first_end_[v] + 1 - len_[v], len_[v], occurrences[v]);
+        }
+    }
+};
+
+const uint32_t PalindromicTree::NONE;
+
+PalindromicTree::PalindromicTree() {
+    addNode(-1, 0, 0);
+    addNode(0, 0, 0);
+}
+
+uint32_t PalindromicTree::addNode(int32_t len, uint32_t suffix_link, uint32_t end) {
+    len_.push_back(len);
+    suffix_link_.push_back(suffix_link);
+    first_edge_.push_back(NONE);
+    first_end_.push_back(end);
+    n_of_suffix_palindroms_.push_back(len > 0 ? n_of_suffix_palindroms_[suffix_link] + 1 : 0);
+    n_of_ends_.push_back(0);
+    return len_.size() - 1;
+}
+
+uint32_t PalindromicTree::findEdge(uint32_t v, unsigned char symbol) const {
+    for (uint32_t e = first_edge_[v]; e != NONE; e = edge_next_[e]) {
+        if (edge_symbol_[e] == symbol) {
+            return edge_to_[e];
+        }
+    }
+    return NONE;
+}
+
+uint32_t PalindromicTree::findExtendable(uint32_t v, size_t i) const {
+    // Ищем по суффиксным ссылкам палиндромный суффикс X, перед которым стоит тот же символ, что text_[i]:
+    // тогда text_[i] X text_[i] - палиндром. Корень длины -1 подходит всегда.
+    while (true) {
+        auto before = static_cast<int64_t>(i) - len_[v] - 1;
+        if (before >= 0 && text_[before] == text_[i]) {
+            return v;
+        }
+        v = suffix_link_[v];
+    }
+}
+
+void PalindromicTree::append(char ch) {
+    size_t i = text_.size();
+    text_ += ch;
+    auto symbol = static_cast<unsigned char>(ch);
+
+    uint32_t parent = findExtendable(last_, i);
+    uint32_t v = findEdge(parent, symbol);
+
+    if (v == NONE) {
+        // Новый палиндром. Его суффиксная ссылка - следующий расширяемый суффикс (или пустой палиндром для длины 1)
+        uint32_t suffix_link = 1;
+        if (len_[parent] != -1) {
+            suffix_link = findEdge(findExtendable(suffix_link_[parent], i), symbol);
+        }
+
+        v = addNode(len_[parent] + 2, suffix_link, i);
+
+        edge_to_.push_back(v);
+        edge_next_.push_back(first_edge_[parent]);
+        edge_symbol_.push_back(symbol);
+        first_edge_[parent] = edge_to_.size() - 1;
+    }
+
+    last_ = v;
+    ++n_of_ends_[v];
+    // каждый палиндромный суффикс новой строки - новая палиндромная подстрока
+    n_of_palindroms_ += n_of_suffix_palindroms_[v];
+    longest_ending_at_.push_back(len_[v]);
+}
+
+// Файл, отображённый в память только для чтения
+class MappedFile {
+private:
+    const char * data_ = nullptr;
+    size_t size_ = 0;
+
+public:
+    explicit MappedFile(const std::string & filename) {
+        int fd = open(filename.c_str(), O_RDONLY);
+        if (fd < 0) {
+            perror(filename.c_str());
+            return;
+        }
+
+        struct stat file_stat{};
+        if (fstat(fd, &file_stat) == 0 && file_stat.st_size > 0) {
+            void * data = mmap(nullptr, file_stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (data != MAP_FAILED) {
+                data_ = static_cast<const char*>(data);
+                size_ = file_stat.st_size;
+                madvise(data, size_, MADV_SEQUENTIAL);
+            }
+            else {
+                perror(filename.c_str());
+            }
+        }
+        close(fd);
+    }
+    ~MappedFile() {
+        if (data_ != nullptr) {
+            munmap(const_cast<char*>(data_), size_);
+        }
+    }
+    MappedFile(const MappedFile &) = delete;
+    MappedFile & operator=(const MappedFile &) = delete;
+
+    const char * data() const {
+        return data_;
+    }
+    size_t size() const {
+        return size_;
+    }
+};
+
+// Статистика по дереву палиндромов: число пар (i, j), число различных палиндромов
+// и самый длинный палиндром (наибольший из longestEndingAt по всем позициям)
+void printPalindromicTreeInfo(const char * data, size_t n, std::ostream & output_stream) {
+    PalindromicTree tree;
+    size_t longest_end = 0;
+    for (size_t i = 0; i < n; ++i) {
+        tree.append(data[i]);
+        if (tree.longestEndingAt(i) > tree.longestEndingAt(longest_end)) {
+            longest_end = i;
+        }
+    }
+
+    output_stream << "Palindromic pairs (i < j): " << tree.countAll() - n << "\n";
+    output_stream << "Distinct palindromes: " << tree.countDistinct() << "\n";
+    if (n > 0) {
+        uint32_t longest = tree.longestEndingAt(longest_end);
+        output_stream << "Longest palindrome: " << std::string(data + longest_end + 1 - longest, longest)
+                      << " at " << longest_end + 1 - longest << std::endl;
+    }
+}
+
+int main(int argc, char** argv) {
+    // 2^28 центров - 1 ГБ радиусов
+    const static size_t WINDOW_SIZE = 1 << 28;
+
+    // -q: после строки идут число запросов q и q пар l r; для каждой выводится число палиндромов в s[l..r]
+    if (argc >= 2 && std::string(argv[1]) == "-q") {
+        std::ios::sync_with_stdio(false);
+
+        std::string input;
+        size_t n_of_queries = 0;
+        std::cin >> input >> n_of_queries;
+
+        // Пустой отрезок (l > r) - 0 палиндромов, в индекс идут только непустые
+        std::vector<std::pair<size_t, size_t>> queries;
+        std::vector<size_t> query_numbers;
+        for (size_t i = 0; i < n_of_queries; ++i) {
+            size_t l = 0, r = 0;
+            if (!(std::cin >> l >> r)) {
+                std::cerr << "query " << i << ": expected two numbers l r" << std::endl;
+                return 1;
+            }
+            if (l > r) {
+                continue;
+            }
+            if (r >= input.size()) {
+                std::cerr << "query " << i << ": r = " << r << " is out of range, string length is " << input.size() << std::endl;
+                return 1;
+            }
+            queries.emplace_back(l, r);
+            query_numbers.push_back(i);
+        }
+
+        std::vector<uint64_t> answers(n_of_queries, 0);
+        PalindromRangeIndex index(input);
+        auto counts = index.count(queries);
+        for (size_t i = 0; i < counts.size(); ++i) {
+            answers[query_numbers[i]] = counts[i];
+        }
+        for (uint64_t answer : answers) {
+            std::cout << answer << "\n";
+        }
+        return 0;
+    }
+
+    // -e: вместо одного числа вывести статистику по дереву палиндромов
+    bool tree_mode = argc >= 2 && std::string(argv[1]) == "-e";
+    int file_arg = tree_mode ? 2 : 1;
+
+    if (argc > file_arg) {
+        // Строка из файла, отображённого в память; перевод строки в конце к строке не относится
+        MappedFile file(argv[file_arg]);
+        size_t n = file.size();
+        while (n > 0 && (file.data()[n - 1] == '\n' || file.data()[n - 1] == '\r')) {
+            --n;
+        }
+        if (tree_mode) {
+            printPalindromicTreeInfo(file.data(), n, std::cout);
+        }
+        else {
+            std::cout << countAllPalindroms(file.data(), n, WINDOW_SIZE);
+        }
+        return 0;
+    }
+
     std::string input;
     std::cin >> input;
 
-    std::cout << calcPalindroms<uneven>(input) + calcPalindroms<even>(input);
+    if (tree_mode) {
+        printPalindromicTreeInfo(input.data(), input.size(), std::cout);
+    }
+    else {
+        std::cout << countAllPalindroms(input.data(), input.size(), WINDOW_SIZE);
+    }
 
     return 0;
-}
+}
\ No newline at end of file
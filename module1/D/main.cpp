@@ -1,70 +1,581 @@
 #include <iostream>
+#include <fstream>
 #include <string>
 #include <utility>
 #include <vector>
-#include <functional>
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <cctype>
+#include <limits>
+#include <thread>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
+// Минимум на отрезке за O(1) при O(n) памяти. Массив делится на блоки по 64 элемента.
+// Внутри блока для каждой позиции r хранится маска позиций j <= r, на которых достигаются минимумы
+// values[j ... r] (стек минимумов при проходе блока слева направо), и минимум на [l, r] внутри блока -
+// младший бит маски r не левее l. Минимумы отрезков из целых блоков берутся из sparse table
+// над минимумами блоков (n / 64 log n чисел). Сам массив values не хранится: он передаётся в query,
+// так что RangeMin не ссылается на чужую память при копировании владельца массива.
+template<class Value>
+class RangeMin {
+private:
+    static const size_t BLOCK_SIZE = 64;
+    std::vector<uint64_t> masks_;
+    // sparse_table_[k][b] - минимум блоков b ... b + 2^k - 1
+    std::vector<std::vector<Value>> sparse_table_;
+
+    Value minInBlock(const Value * values, size_t left, size_t right) const {
+        uint64_t mask = masks_[right] & (~0ull << (left % BLOCK_SIZE));
+        return values[right / BLOCK_SIZE * BLOCK_SIZE + __builtin_ctzll(mask)];
+    }
+
+public:
+    RangeMin() = default;
+    RangeMin(const Value * values, size_t size) : masks_(size) {
+        size_t n_of_blocks = (size + BLOCK_SIZE - 1) / BLOCK_SIZE;
+        sparse_table_.emplace_back(n_of_blocks);
+
+        for (size_t block = 0; block < n_of_blocks; ++block) {
+            size_t begin = block * BLOCK_SIZE;
+            size_t end = std::min(size, begin + BLOCK_SIZE);
+            uint64_t mask = 0;
+            for (size_t i = begin; i < end; ++i) {
+                // Снимаем со стека позиции, значения на которых не меньше values[i]
+                while (mask != 0 && values[begin + 63 - __builtin_clzll(mask)] >= values[i]) {
+                    mask &= ~(1ull << (63 - __builtin_clzll(mask)));
+                }
+                mask |= 1ull << (i - begin);
+                masks_[i] = mask;
+            }
+            // Дно стека на конце блока - минимум всего блока
+            sparse_table_[0][block] = values[begin + __builtin_ctzll(mask)];
+        }
+
+        for (size_t k = 1; (1ul << k) <= n_of_blocks; ++k) {
+            const auto & previous = sparse_table_[k - 1];
+            std::vector<Value> level(n_of_blocks - (1ul << k) + 1);
+            for (size_t block = 0; block < level.size(); ++block) {
+                level[block] = std::min(previous[block], previous[block + (1ul << (k - 1))]);
+            }
+            sparse_table_.push_back(std::move(level));
+        }
+    }
+
+    // Минимум values[left ... right], left <= right; values - тот же массив, что и в конструкторе
+    Value query(const Value * values, size_t left, size_t right) const {
+        size_t left_block = left / BLOCK_SIZE;
+        size_t right_block = right / BLOCK_SIZE;
+        if (left_block == right_block) {
+            return minInBlock(values, left, right);
+        }
+
+        Value result = std::min(minInBlock(values, left, left_block * BLOCK_SIZE + BLOCK_SIZE - 1),
+                                minInBlock(values, right_block * BLOCK_SIZE, right));
+        if (left_block + 1 < right_block) {
+            int k = 63 - __builtin_clzll(right_block - left_block - 1);
+            const auto & level = sparse_table_[k];
+            result = std::min({result, level[left_block + 1], level[right_block - (1ul << k)]});
+        }
+        return result;
+    }
+
+    size_t memoryUsage() const {
+        size_t result = masks_.size() * sizeof(uint64_t);
+        for (const auto & level : sparse_table_) {
+            result += level.size() * sizeof(Value);
+        }
+        return result;
+    }
+};
+
+// Суффиксный массив последовательности символов типа Symbol (uint8_t, uint16_t, uint32_t) с индексами типа Index.
+// uint32_t хватает для текстов до 4 ГБ и вдвое экономит память по сравнению с uint64_t.
+// В конец текста добавляется терминатор, который везде считается меньше всех символов.
+template<class Index = uint32_t, class Symbol = unsigned char>
 class SuffixArray {
+    friend class FMIndex;
+
+    static_assert(std::is_unsigned<Index>::value && std::is_unsigned<Symbol>::value, "index and symbol types must be unsigned");
+    static_assert(sizeof(Symbol) <= 4, "symbols wider than 32 bits are not supported");
+
+public:
+    using Text = std::vector<Symbol>;
+
 private:
-    const size_t ALPHABET_SIZE = 256;
+    // Символы text_ - из [0, alphabet_size_)
+    size_t alphabet_size_;
 
     // The order of fields is important (member initializing list)
-    std::string text_;
+    Text text_;
     size_t size_;
-    std::vector<int> suffix_array_;
-    std::vector<int> equivalence_classes_;
-    std::vector<int> LCP_;
+    std::vector<Index> suffix_array_;
+    std::vector<Index> equivalence_classes_;
+    std::vector<Index> LCP_;
     size_t n_of_classes_ = 0;
 
-    void fillSuffixArray();
+    // LCP-LR для бинпоиска: lcp середины отрезка бинпоиска с его левым и правым концом.
+    // Обе половины лежат рядом, чтобы шаг бинпоиска читал одну кэш-линию
+    struct LCPLR {
+        Index left;
+        Index right;
+    };
+    std::vector<LCPLR> LCP_LR_;
+
+    // Для LCE: позиция каждого суффикса в суффиксном массиве и минимум на отрезке LCP_
+    std::vector<Index> rank_;
+    RangeMin<Index> LCP_range_min_;
+
+    // Буферы сортировки удвоением, выделяются один раз и переиспользуются на каждом шаге
+    std::vector<Index> suffix_array_1_;
+    std::vector<Index> equivalence_classes_1_;
+    std::vector<Index> counter_;
+
+    size_t n_of_threads_;
+
+public:
+    // Алгоритм построения суффиксного массива
+    enum class Builder {
+        sais,           // SA-IS, O(n)
+        doubling,       // удвоение длины циклических подстрок, O(n log n)
+        radixDoubling   // удвоение с поразрядной сортировкой пар рангов и без уже отсортированных групп,
+                        // строится в n_of_threads потоков. Пара (группа, ранг) упаковывается в 64-битный ключ,
+                        // поэтому нужно 2 * max(бит на n, бит на alphabet_size) <= 64 (до 2^32 суффиксов);
+                        // для больших текстов и алфавитов вместо него строится sais
+    };
+
+private:
+    void fillSuffixArray(Builder builder);
+    void fillSuffixArrayUsingDoubling();
+    void fillSuffixArrayUsingSAIS();
+    void fillSuffixArrayUsingRadixDoubling();
+    // Помещается ли пара (номер группы, ранг) в 64-битный ключ fillSuffixArrayUsingRadixDoubling
+    bool radixKeysFit() const;
 
     void sortByFirst2PowKSymbols(size_t k);
     void buildLCPUsingKasai();
+    void buildLCPUsingPhi();
+
+    void buildLCPLR();
+    Index fillLCPLR(long left, long right);
+    // Состояние бинпоиска: отрезок (left, right) и lcp pattern с его концами
+    struct Bound {
+        long left;
+        long right;
+        size_t left_match;
+        size_t right_match;
+    };
+    long findBound(const Text & pattern, Bound & bound, bool is_prefix_less, bool stop_at_pattern) const;
+    // [begin, end) - отрезок суффиксного массива из суффиксов, начинающихся с pattern
+    std::pair<size_t, size_t> findRange(const Text & pattern) const;
+    // Вызывает on_range(i, findRange(patterns[i])) для всех шаблонов в n_of_threads потоков
+    template<class Callback>
+    void findRanges(const std::vector<Text> & patterns, Callback on_range);
 
 public:
-    explicit SuffixArray(std::string text);
+    // alphabet_size = 0 - по наибольшему символу текста, иначе все символы должны быть меньше alphabet_size.
+    // Память на сортировку пропорциональна alphabet_size, поэтому алфавит должен быть плотным: редкие
+    // большие номера (например, id слов при Symbol = uint32_t) сначала нужно заменить их рангами 0, 1, 2, ...
+    explicit SuffixArray(Text text, Builder builder = Builder::sais, size_t n_of_threads = 1, size_t alphabet_size = 0);
     size_t calcDifferentSubstrings();
+
+    // Записывает текст, суффиксный массив (каждый sa_sample_rate-й элемент) и LCP в файл индекса,
+    // который потом открывается SuffixArrayIndex
+    bool save(const std::string & filename, size_t sa_sample_rate = 1);
+
+    // Число вхождений pattern в текст и позиции их начал (в порядке суффиксного массива), O(p + log n)
+    size_t count(const Text & pattern);
+    std::vector<Index> locate(const Text & pattern);
+    // То же для многих шаблонов сразу, шаблоны делятся между n_of_threads потоками
+    std::vector<size_t> count(const std::vector<Text> & patterns);
+    std::vector<std::vector<Index>> locate(const std::vector<Text> & patterns);
+
+    // Строит массив рангов и RMQ над LCP для longestCommonExtension
+    void buildLCE();
+    // Длина общего префикса суффиксов text_[i ...] и text_[j ...] (без терминатора), O(1)
+    size_t longestCommonExtension(size_t i, size_t j) const;
+
+    // Фраза разбиения LZ77: length > 0 - копия text_[source ... source + length), length == 0 - литерал source
+    struct LZFactor {
+        Index source;
+        Index length;
+    };
+    // Жадное разбиение LZ77 (источник может перекрываться с фразой), O(n)
+    std::vector<LZFactor> factorizeLZ77() const;
+
+    // Повтор text_[position ... position + length), встречающийся n_of_occurrences раз
+    struct Repeat {
+        Index position;
+        Index length;
+        Index n_of_occurrences;
+    };
+    // Максимальные повторы (не продолжаются ни влево, ни вправо сразу во всех вхождениях) длины >= min_length
+    std::vector<Repeat> findMaximalRepeats(size_t min_length = 1);
+    // Супермаксимальные повторы (не являются подстрокой другого повтора) длины >= min_length
+    std::vector<Repeat> findSupermaximalRepeats(size_t min_length = 1);
+
+private:
+    // Символ перед суффиксом suffix_array_[p], у суффикса всего текста его нет - NO_LEFT_SYMBOL
+    static constexpr size_t NO_LEFT_SYMBOL = std::numeric_limits<size_t>::max();
+    size_t leftSymbol(size_t p) const;
+    // Обходит lcp-интервалы [left, right] суффиксного массива снизу вверх: on_interval(lcp, left, right, has_child)
+    template<class Callback>
+    void forEachLCPInterval(Callback on_interval);
 };
 
 // size_ = text_.size() + 1 because in constructor body we increase text_, but it executed finally
-SuffixArray::SuffixArray(std::string text) : text_(std::move(text)), size_(text_.size() + 1), suffix_array_(size_), equivalence_classes_(size_){
-    text_ += '$';
+template<class Index, class Symbol>
+SuffixArray<Index, Symbol>::SuffixArray(Text text, Builder builder, size_t n_of_threads, size_t alphabet_size)
+        : alphabet_size_(alphabet_size), text_(std::move(text)), size_(text_.size() + 1), suffix_array_(size_),
+          n_of_threads_(std::max<size_t>(1, n_of_threads)) {
+    // Наибольшее значение Index занято под пустые ячейки в SA-IS и Φ
+    assert(size_ < std::numeric_limits<Index>::max() && "text is too long for the index type");
+    if (alphabet_size_ == 0) {
+        alphabet_size_ = text_.empty() ? 1 : static_cast<size_t>(*std::max_element(text_.begin(), text_.end())) + 1;
+    }
+    // SA-IS и сортировка подсчётом заводят по ячейке на каждый символ алфавита
+    assert((text_.empty() || static_cast<size_t>(*std::max_element(text_.begin(), text_.end())) < alphabet_size_)
+           && "text symbol does not fit in alphabet_size");
+    // Значение терминатора не используется (он меньше всех символов), '$' - чтобы текст в файле индекса был читаемым
+    text_.push_back(static_cast<Symbol>('$'));
 
-    fillSuffixArray();
+    fillSuffixArray(builder);
 }
 
-std::vector<int> count(const size_t & alphabet_size, const std::function<int (size_t i)>& getI, const size_t & src_size) {
-    // функция расчёта позиции элементов, получаемых из getI(size_t i) в сортировке подсчётом
+template<class Counter, class GetKey>
+void count(Counter * counter, size_t alphabet_size, GetKey get_key, size_t src_size) {
+    // функция расчёта позиции элементов, получаемых из get_key(i) в сортировке подсчётом,
+    // результат записывается в counter[0 ... alphabet_size - 1]
 
-    std::vector<int> counter(alphabet_size, 0);
+    std::fill(counter, counter + alphabet_size, 0);
 
     for (size_t i = 0; i < src_size; ++i) {
-        ++counter[getI(i)];
+        ++counter[get_key(i)];
     }
     for (size_t i = 1; i < alphabet_size; ++i) {
         counter[i] += counter[i - 1];
     }
+}
+
+// SA-IS (Nong, Zhang, Chan): суффиксы делятся на S-типа (меньше следующего суффикса) и L-типа (больше),
+// сортируются только LMS-подстроки (S-суффикс, перед которым L-суффикс), по ним индуцированной сортировкой
+// восстанавливается порядок всех суффиксов. Если имена LMS-подстрок не уникальны, задача рекурсивно решается
+// для строки из имён, которая не длиннее n / 2. Время O(n).
+//
+// symbols[i] - символ из [0, alphabet_size), последний символ строки должен быть единственным нулём.
+// Память: сам suffix_array (он же рабочий буфер для рекурсии), n бит типов и корзины размера алфавита.
+// Пустые ячейки suffix_array помечаются наибольшим значением Index.
+namespace sais {
+
+template<class Symbols, class Index>
+void getBuckets(const Symbols & symbols, size_t n, std::vector<Index> & bucket, bool end) {
+    // bucket[c] - начало (или конец) корзины символа c в суффиксном массиве
+    std::fill(bucket.begin(), bucket.end(), 0);
+    for (size_t i = 0; i < n; ++i) {
+        ++bucket[symbols[i]];
+    }
+    Index sum = 0;
+    for (auto & size : bucket) {
+        sum += size;
+        size = end ? sum : sum - size;
+    }
+}
+
+inline bool isLMS(const std::vector<bool> & is_s_type, size_t i) {
+    return i > 0 && is_s_type[i] && !is_s_type[i - 1];
+}
+
+template<class Symbols, class Index>
+void induce(const Symbols & symbols, Index * suffix_array, size_t n, const std::vector<bool> & is_s_type, std::vector<Index> & bucket) {
+    const Index EMPTY = std::numeric_limits<Index>::max();
+
+    // L-суффиксы: проходом слева направо ставим i - 1 в начало его корзины
+    getBuckets(symbols, n, bucket, false);
+    for (size_t i = 0; i < n; ++i) {
+        Index j = suffix_array[i];
+        if (j != EMPTY && j > 0 && !is_s_type[j - 1]) {
+            suffix_array[bucket[symbols[j - 1]]++] = j - 1;
+        }
+    }
+    // S-суффиксы: проходом справа налево ставим i - 1 в конец его корзины
+    getBuckets(symbols, n, bucket, true);
+    for (size_t i = n; i > 0; --i) {
+        Index j = suffix_array[i - 1];
+        if (j != EMPTY && j > 0 && is_s_type[j - 1]) {
+            suffix_array[--bucket[symbols[j - 1]]] = j - 1;
+        }
+    }
+}
+
+// Строка имён LMS-подстрок для рекурсии
+template<class Index>
+struct IndexSymbols {
+    const Index * data;
+    Index operator[](size_t i) const {
+        return data[i];
+    }
+};
+
+template<class Symbols, class Index>
+void build(const Symbols & symbols, Index * suffix_array, size_t n, size_t alphabet_size) {
+    const Index EMPTY = std::numeric_limits<Index>::max();
+
+    if (n == 1) {
+        suffix_array[0] = 0;
+        return;
+    }
+
+    std::vector<bool> is_s_type(n);
+    is_s_type[n - 1] = true;
+    is_s_type[n - 2] = false;
+    for (size_t i = n - 2; i > 0; --i) {
+        is_s_type[i - 1] = symbols[i - 1] < symbols[i] || (symbols[i - 1] == symbols[i] && is_s_type[i]);
+    }
+
+    // 1. Сортируем LMS-подстроки: кладём LMS-суффиксы в концы корзин и индуцируем
+    std::vector<Index> bucket(alphabet_size);
+    getBuckets(symbols, n, bucket, true);
+    std::fill(suffix_array, suffix_array + n, EMPTY);
+    for (size_t i = 1; i < n; ++i) {
+        if (isLMS(is_s_type, i)) {
+            suffix_array[--bucket[symbols[i]]] = i;
+        }
+    }
+    induce(symbols, suffix_array, n, is_s_type, bucket);
+
+    // Сжимаем отсортированные LMS-подстроки в начало массива
+    size_t n1 = 0;
+    for (size_t i = 0; i < n; ++i) {
+        if (suffix_array[i] != EMPTY && isLMS(is_s_type, suffix_array[i])) {
+            suffix_array[n1++] = suffix_array[i];
+        }
+    }
+
+    // Даём LMS-подстрокам имена: равные подстроки - равные имена. Имя подстроки, начинающейся в pos,
+    // пишем в suffix_array[n1 + pos / 2] (LMS-позиции отстоят друг от друга хотя бы на 2)
+    std::fill(suffix_array + n1, suffix_array + n, EMPTY);
+    size_t name = 0;
+    size_t previous = EMPTY;
+    for (size_t i = 0; i < n1; ++i) {
+        size_t pos = suffix_array[i];
+        bool is_different = false;
+        for (size_t d = 0; d < n; ++d) {
+            if (previous == EMPTY || symbols[pos + d] != symbols[previous + d] || is_s_type[pos + d] != is_s_type[previous + d]) {
+                is_different = true;
+                break;
+            }
+            if (d > 0 && (isLMS(is_s_type, pos + d) || isLMS(is_s_type, previous + d))) {
+                break;
+            }
+        }
+        if (is_different) {
+            ++name;
+            previous = pos;
+        }
+        suffix_array[n1 + pos / 2] = name - 1;
+    }
+    for (size_t i = n, j = n; i > n1; --i) {
+        if (suffix_array[i - 1] != EMPTY) {
+            suffix_array[--j] = suffix_array[i - 1];
+        }
+    }
+
+    // 2. Сортируем LMS-суффиксы: рекурсивно, если имена не уникальны, иначе порядок задают сами имена
+    Index * suffix_array_1 = suffix_array;
+    Index * symbols_1 = suffix_array + n - n1;
+    if (name < n1) {
+        build(IndexSymbols<Index>{symbols_1}, suffix_array_1, n1, name);
+    }
+    else {
+        for (size_t i = 0; i < n1; ++i) {
+            suffix_array_1[symbols_1[i]] = i;
+        }
+    }
+
+    // 3. Индуцируем порядок всех суффиксов по отсортированным LMS-суффиксам
+    getBuckets(symbols, n, bucket, true);
+    for (size_t i = 1, j = 0; i < n; ++i) {
+        if (isLMS(is_s_type, i)) {
+            symbols_1[j++] = i;
+        }
+    }
+    for (size_t i = 0; i < n1; ++i) {
+        suffix_array_1[i] = symbols_1[suffix_array_1[i]];
+    }
+    std::fill(suffix_array + n1, suffix_array + n, EMPTY);
+    for (size_t i = n1; i > 0; --i) {
+        Index j = suffix_array[i - 1];
+        suffix_array[i - 1] = EMPTY;
+        suffix_array[--bucket[symbols[j]]] = j;
+    }
+    induce(symbols, suffix_array, n, is_s_type, bucket);
+}
+
+} // namespace sais
+
+// Символы text_ для сортировки: последний символ - единственный и наименьший (0), остальные сдвинуты на 1
+template<class Symbol>
+struct TextSymbols {
+    const Symbol * text;
+    size_t last;
+    size_t operator[](size_t i) const {
+        return i == last ? 0 : static_cast<size_t>(text[i]) + 1;
+    }
+};
+
+int bitWidth(uint64_t x) {
+    // количество бит, нужное для записи x
+    int width = 0;
+    for (; x > 0; x >>= 1u) {
+        ++width;
+    }
+    return width;
+}
+
+// Начало куска part из n_of_parts примерно равных кусков отрезка [0, size)
+inline size_t chunkBegin(size_t size, size_t n_of_parts, size_t part) {
+    return size * part / n_of_parts;
+}
+
+// Выполняет task(t) для t = 0 ... n_of_threads - 1, task(0) - в текущем потоке
+template<class Task>
+void runInThreads(size_t n_of_threads, const Task & task) {
+    std::vector<std::thread> workers;
+    for (size_t t = 1; t < n_of_threads; ++t) {
+        workers.emplace_back([&task, t]() { task(t); });
+    }
+    task(0);
+    for (auto & worker : workers) {
+        worker.join();
+    }
+}
+
+template<class Value>
+void radixSort(std::vector<uint64_t> & keys, std::vector<Value> & values,
+               std::vector<uint64_t> & keys_1, std::vector<Value> & values_1, size_t size, int key_bits,
+               size_t n_of_threads) {
+    // LSD поразрядная сортировка первых size пар (keys[i], values[i]) по ключу, в котором значимы только
+    // младшие key_bits бит. Разряды по 11 бит (гистограмма разряда помещается в L1), гистограммы всех
+    // разрядов считаются за один проход, разряды, одинаковые у всех ключей, пропускаются.
+    // Результат остаётся в keys и values.
+    //
+    // Массив делится на n_of_threads кусков, у каждого потока свои гистограммы, и элементы значения c
+    // из куска t пишутся после элементов значения c из кусков 0 ... t - 1, поэтому сортировка остаётся устойчивой.
+    // После перестановки куски состоят уже из других элементов, и следующий разряд приходится считать заново.
+    const int DIGIT_BITS = 11;
+    const size_t N_OF_DIGIT_VALUES = 1u << DIGIT_BITS;
+    const int n_of_digits = (key_bits + DIGIT_BITS - 1) / DIGIT_BITS;
+
+    auto digit = [](uint64_t key, int d) { return (key >> (d * DIGIT_BITS)) & (N_OF_DIGIT_VALUES - 1); };
+
+    // counter[(t * n_of_digits + d) * N_OF_DIGIT_VALUES + c] - число ключей куска t со значением c в разряде d
+    std::vector<size_t> counter(n_of_threads * n_of_digits * N_OF_DIGIT_VALUES, 0);
+    auto countDigits = [&](size_t t, int first_digit, int last_digit) {
+        size_t * thread_counter = counter.data() + t * n_of_digits * N_OF_DIGIT_VALUES;
+        std::fill(thread_counter + first_digit * N_OF_DIGIT_VALUES, thread_counter + last_digit * N_OF_DIGIT_VALUES, 0);
+
+        for (size_t i = chunkBegin(size, n_of_threads, t); i < chunkBegin(size, n_of_threads, t + 1); ++i) {
+            for (int d = first_digit; d < last_digit; ++d) {
+                ++thread_counter[d * N_OF_DIGIT_VALUES + digit(keys[i], d)];
+            }
+        }
+    };
+
+    runInThreads(n_of_threads, [&](size_t t) { countDigits(t, 0, n_of_digits); });
+
+    bool is_counter_actual = true;
+    for (int d = 0; d < n_of_digits; ++d) {
+        size_t n_of_equal_digits = 0;
+        for (size_t t = 0; t < n_of_threads; ++t) {
+            n_of_equal_digits += counter[(t * n_of_digits + d) * N_OF_DIGIT_VALUES + digit(keys[0], d)];
+        }
+        if (n_of_equal_digits == size) {
+            continue;
+        }
+
+        if (!is_counter_actual) {
+            runInThreads(n_of_threads, [&](size_t t) { countDigits(t, d, d + 1); });
+        }
+
+        size_t sum = 0;
+        for (size_t c = 0; c < N_OF_DIGIT_VALUES; ++c) {
+            for (size_t t = 0; t < n_of_threads; ++t) {
+                size_t & starts_with = counter[(t * n_of_digits + d) * N_OF_DIGIT_VALUES + c];
+                size_t n_of_keys = starts_with;
+                starts_with = sum;
+                sum += n_of_keys;
+            }
+        }
+
+        runInThreads(n_of_threads, [&](size_t t) {
+            size_t * starts_with = counter.data() + (t * n_of_digits + d) * N_OF_DIGIT_VALUES;
+            for (size_t i = chunkBegin(size, n_of_threads, t); i < chunkBegin(size, n_of_threads, t + 1); ++i) {
+                size_t j = starts_with[digit(keys[i], d)]++;
+                keys_1[j] = keys[i];
+                values_1[j] = values[i];
+            }
+        });
+        keys.swap(keys_1);
+        values.swap(values_1);
+
+        // Гистограммы одного потока остаются верными для всех разрядов
+        is_counter_actual = n_of_threads == 1;
+    }
+}
+
+template<class Index, class Symbol>
+void SuffixArray<Index, Symbol>::fillSuffixArray(Builder builder) {
+    if (builder == Builder::sais) {
+        fillSuffixArrayUsingSAIS();
+    }
+    else if (builder == Builder::radixDoubling && radixKeysFit()) {
+        fillSuffixArrayUsingRadixDoubling();
+    }
+    else if (builder == Builder::radixDoubling) {
+        fillSuffixArrayUsingSAIS();
+    }
+    else {
+        fillSuffixArrayUsingDoubling();
+    }
+}
 
-    return std::move(counter);
+template<class Index, class Symbol>
+void SuffixArray<Index, Symbol>::fillSuffixArrayUsingSAIS() {
+    // Терминатор в конце text_ считаем меньше всех символов, поэтому порядок совпадает с циклической сортировкой
+    sais::build(TextSymbols<Symbol>{text_.data(), size_ - 1}, suffix_array_.data(), size_, alphabet_size_ + 1);
 }
 
-void SuffixArray::fillSuffixArray() {
-    // Сначала отсортируем подстроки по 0му символу (нумерация с нуля)
+template<class Index, class Symbol>
+void SuffixArray<Index, Symbol>::fillSuffixArrayUsingDoubling() {
+    equivalence_classes_.resize(size_);
+    suffix_array_1_.resize(size_);
+    equivalence_classes_1_.resize(size_);
+    counter_.resize(std::max(alphabet_size_ + 1, size_));
+
+    // Сначала отсортируем подстроки по 0му символу (нумерация с нуля).
+    // Терминатор - символ 0, меньше всех, как в SA-IS, остальные символы сдвинуты на 1
 
     // Получаем позиции символов из text и делаем сортировку подсчётом, точнее записываем,
     // какая строка будет стоять на i-ой позиции в suffix_array
-    auto startsWith = count(ALPHABET_SIZE, [this](size_t i){ return text_[i]; }, size_);
+    TextSymbols<Symbol> symbols{text_.data(), size_ - 1};
+    Index * startsWith = counter_.data();
+    ::count(startsWith, alphabet_size_ + 1, [symbols](size_t i){ return symbols[i]; }, size_);
     for (size_t i = 0; i < size_; ++i) {
-        --startsWith[text_[i]];
+        --startsWith[symbols[i]];
 
-        suffix_array_[startsWith[text_[i]]] = i;
+        suffix_array_[startsWith[symbols[i]]] = i;
     }
 
     // Потом заполним массив классов эквивалентностей
 
     n_of_classes_ = 1;
     for (size_t i = 1; i < size_; ++i) {
-        if (text_[suffix_array_[i]] != text_[suffix_array_[i - 1]]) {
+        if (symbols[suffix_array_[i]] != symbols[suffix_array_[i - 1]]) {
             ++n_of_classes_;
         }
 
@@ -86,27 +597,201 @@ void SuffixArray::fillSuffixArray() {
 
         sortByFirst2PowKSymbols(k);
     }
+
+    // Буферы больше не нужны, освобождаем память
+    std::vector<Index>().swap(suffix_array_1_);
+    std::vector<Index>().swap(equivalence_classes_1_);
+    std::vector<Index>().swap(counter_);
+}
+
+template<class Index, class Symbol>
+bool SuffixArray<Index, Symbol>::radixKeysFit() const {
+    return 2 * std::max(bitWidth(size_), bitWidth(alphabet_size_)) <= 64;
+}
+
+template<class Index, class Symbol>
+void SuffixArray<Index, Symbol>::fillSuffixArrayUsingRadixDoubling() {
+    // Удвоение (Larsson–Sadakane): суффиксы разбиты на группы с одинаковыми первыми k символами,
+    // ранг суффикса - позиция начала его группы в suffix_array_. На шаге k каждая группа из нескольких суффиксов
+    // сортируется по рангу суффикса i + k. Группы из одного суффикса уже стоят на своих местах
+    // и в следующих шагах не участвуют, поэтому на повторяющихся строках шаги быстро становятся дешёвыми.
+    //
+    // Пара (номер группы, ранг суффикса i + k) упаковывается в один 64-битный ключ, и все группы шага
+    // сортируются одной поразрядной сортировкой по непрерывному массиву: номера групп идут по возрастанию,
+    // поэтому после сортировки каждая группа остаётся на своём отрезке. Шаг k = 0 - сортировка
+    // единственной группы из всех суффиксов по первому символу.
+    //
+    // Терминатор в конце text_ считаем меньше всех символов (как в SA-IS). Тогда у суффиксов неотсортированной группы
+    // первые k символов не содержат терминатор, то есть i + k < size_, и "закольцовывать" подстроки не нужно.
+    //
+    // Каждый шаг (сбор ключей, сортировка, разбиение групп) делится между n_of_threads_ потоками
+    // по элементам, а не по группам, так что одна большая группа тоже сортируется параллельно.
+
+    const size_t MIN_KEYS_PER_THREAD = 1u << 16u;
+    const size_t NO_BORDER = std::numeric_limits<size_t>::max();
+
+    TextSymbols<Symbol> symbols{text_.data(), size_ - 1};
+    equivalence_classes_.resize(size_);
+    std::vector<Index> & rank = equivalence_classes_;
+
+    for (size_t i = 0; i < size_; ++i) {
+        suffix_array_[i] = i;
+    }
+
+    // Отрезки [begin, end) suffix_array_ с группами, в которых больше одного суффикса
+    std::vector<std::pair<Index, Index>> groups = {{0, static_cast<Index>(size_)}};
+    std::vector<std::vector<std::pair<Index, Index>>> next_groups(n_of_threads_);
+
+    // offsets[g] - позиция первого ключа группы g
+    std::vector<size_t> offsets;
+    std::vector<size_t> offsets_of_chunks(n_of_threads_ + 1);
+    std::vector<size_t> last_borders(n_of_threads_);
+
+    std::vector<uint64_t> keys(size_);
+    std::vector<uint64_t> keys_1(size_);
+    std::vector<Index> suffixes(size_);
+    std::vector<Index> suffixes_1(size_);
+    const int rank_bits = std::max(bitWidth(size_), bitWidth(alphabet_size_));
+    // Ключ - пара (номер группы, ранг), номеров групп не больше size_; fillSuffixArray это уже проверил
+    assert(radixKeysFit() && "ranks do not fit in 64-bit keys");
+
+    for (size_t k = 0; !groups.empty(); k = (k == 0 ? 1 : k << 1u)) {
+        size_t n_of_groups = groups.size();
+
+        // Позиции групп среди ключей - префиксные суммы размеров групп, сначала по кускам, потом внутри кусков
+        size_t n_of_threads = std::min(n_of_threads_, std::max<size_t>(1, n_of_groups / MIN_KEYS_PER_THREAD));
+        offsets.resize(n_of_groups + 1);
+        runInThreads(n_of_threads, [&](size_t t) {
+            size_t sum = 0;
+            for (size_t g = chunkBegin(n_of_groups, n_of_threads, t); g < chunkBegin(n_of_groups, n_of_threads, t + 1); ++g) {
+                sum += groups[g].second - groups[g].first;
+            }
+            offsets_of_chunks[t + 1] = sum;
+        });
+        offsets_of_chunks[0] = 0;
+        for (size_t t = 0; t < n_of_threads; ++t) {
+            offsets_of_chunks[t + 1] += offsets_of_chunks[t];
+        }
+        runInThreads(n_of_threads, [&](size_t t) {
+            size_t sum = offsets_of_chunks[t];
+            for (size_t g = chunkBegin(n_of_groups, n_of_threads, t); g < chunkBegin(n_of_groups, n_of_threads, t + 1); ++g) {
+                offsets[g] = sum;
+                sum += groups[g].second - groups[g].first;
+            }
+        });
+        const size_t n_of_keys = offsets_of_chunks[n_of_threads];
+        offsets[n_of_groups] = n_of_keys;
+
+        n_of_threads = std::min(n_of_threads_, std::max<size_t>(1, n_of_keys / MIN_KEYS_PER_THREAD));
+
+        // Сбор ключей: поток берёт свой кусок ключей, первую группу куска находит бинпоиском по offsets
+        runInThreads(n_of_threads, [&](size_t t) {
+            size_t p = chunkBegin(n_of_keys, n_of_threads, t);
+            size_t end = chunkBegin(n_of_keys, n_of_threads, t + 1);
+            size_t g = std::upper_bound(offsets.begin(), offsets.end(), p) - offsets.begin() - 1;
+
+            for (; p < end; ++p) {
+                while (offsets[g + 1] <= p) {
+                    ++g;
+                }
+                size_t i = suffix_array_[groups[g].first + (p - offsets[g])];
+                uint64_t second = k == 0 ? symbols[i] : rank[i + k];
+                keys[p] = (static_cast<uint64_t>(g) << rank_bits) | second;
+                suffixes[p] = i;
+            }
+        });
+
+        radixSort(keys, suffixes, keys_1, suffixes_1, n_of_keys, bitWidth(n_of_groups - 1) + rank_bits, n_of_threads);
+
+        // Разбиение групп. Новая группа начинается там, где ключ отличается от предыдущего,
+        // её ранг - позиция её начала. Граница группы может попасть в кусок другого потока,
+        // поэтому сначала каждый поток находит последнюю границу в своём куске.
+        auto isBorder = [&](size_t p) { return p == 0 || p == n_of_keys || keys[p] != keys[p - 1]; };
+        auto positionOf = [&](size_t p) {
+            size_t g = keys[p] >> rank_bits;
+            return groups[g].first + (p - offsets[g]);
+        };
+
+        runInThreads(n_of_threads, [&](size_t t) {
+            last_borders[t] = NO_BORDER;
+            for (size_t p = chunkBegin(n_of_keys, n_of_threads, t + 1); p > chunkBegin(n_of_keys, n_of_threads, t); --p) {
+                if (isBorder(p - 1)) {
+                    last_borders[t] = p - 1;
+                    break;
+                }
+            }
+        });
+
+        // Ранги предыдущего шага уже упакованы в ключи, поэтому новые можно записывать сразу
+        runInThreads(n_of_threads, [&](size_t t) {
+            size_t begin = chunkBegin(n_of_keys, n_of_threads, t);
+            size_t end = chunkBegin(n_of_keys, n_of_threads, t + 1);
+            auto & thread_groups = next_groups[t];
+            thread_groups.clear();
+
+            // Начало группы, в которой лежит ключ begin (в куске 0 граница всегда есть)
+            size_t group_begin = 0;
+            for (size_t s = t; s > 0; --s) {
+                if (last_borders[s - 1] != NO_BORDER) {
+                    group_begin = last_borders[s - 1];
+                    break;
+                }
+            }
+            size_t group_position = positionOf(group_begin);
+
+            auto closeGroup = [&](size_t group_end) {
+                if (group_end - group_begin > 1) {
+                    thread_groups.emplace_back(group_position, group_position + (group_end - group_begin));
+                }
+            };
+
+            for (size_t p = begin; p < end; ++p) {
+                if (isBorder(p)) {
+                    if (p > begin) {
+                        closeGroup(p);
+                    }
+                    group_begin = p;
+                    group_position = positionOf(p);
+                }
+                suffix_array_[group_position + (p - group_begin)] = suffixes[p];
+                rank[suffixes[p]] = group_position;
+            }
+            if (begin < end && isBorder(end)) {
+                closeGroup(end);
+            }
+        });
+
+        groups.clear();
+        for (size_t t = 0; t < n_of_threads; ++t) {
+            groups.insert(groups.end(), next_groups[t].begin(), next_groups[t].end());
+        }
+    }
+
+    n_of_classes_ = size_;
 }
 
-void SuffixArray::sortByFirst2PowKSymbols(size_t k) {
+template<class Index, class Symbol>
+void SuffixArray<Index, Symbol>::sortByFirst2PowKSymbols(size_t k) {
     // На этом шаге сортировки выходным результатом будут отсортированные строки длины 2^k символов
 
     // Эта функция сортирует подстроки text_[2^(k - 1) ... 2^k - 1] (нумерация с нуля) и записывает результат в suffix_array_,
     // используя уже отсортированные строки text_[0 ... 2^(k - 1) - 1]
 
-    std::vector<int> suffix_array_1(size_);
-    std::vector<int> equivalence_classes_1(size_);
+    Index * suffix_array_1 = suffix_array_1_.data();
+    Index * equivalence_classes_1 = equivalence_classes_1_.data();
+    const Index * equivalence_classes = equivalence_classes_.data();
 
     // "закольцовываем" подстроки
     for (size_t i = 0; i < size_; ++i) {
-        suffix_array_1[i] = (suffix_array_[i] - k + size_) % size_;
+        suffix_array_1[i] = (suffix_array_[i] + size_ - k) % size_;
     }
 
     // Получаем позиции начала классов эквивалентностей подстрок из suffix_array_1
     // и сортируем подстроки из suffix_array_1 подсчётом (записываем в suffix_array_).
-    auto startsWith = count(n_of_classes_, [this, suffix_array_1](size_t i){ return equivalence_classes_[suffix_array_1[i]];}, size_);
+    Index * startsWith = counter_.data();
+    ::count(startsWith, n_of_classes_, [equivalence_classes, suffix_array_1](size_t i){ return equivalence_classes[suffix_array_1[i]]; }, size_);
     for (size_t i = size_; i > 0; --i) {
-        auto & j = startsWith[equivalence_classes_[suffix_array_1[i - 1]]];
+        auto & j = startsWith[equivalence_classes[suffix_array_1[i - 1]]];
         --j;
         suffix_array_[j] = suffix_array_1[i - 1];
     }
@@ -132,14 +817,15 @@ void SuffixArray::sortByFirst2PowKSymbols(size_t k) {
         equivalence_classes_1[suffix_array_[i]] = n_of_classes_ - 1;
     }
 
-    // Сохраняем новый классы эквивалентности подстрок
-    equivalence_classes_ = std::move(equivalence_classes_1);
+    // Сохраняем новый классы эквивалентности подстрок (старый буфер пойдёт под следующий шаг)
+    equivalence_classes_.swap(equivalence_classes_1_);
 }
 
-void SuffixArray::buildLCPUsingKasai() {
+template<class Index, class Symbol>
+void SuffixArray<Index, Symbol>::buildLCPUsingKasai() {
     // Алгоритм Касаи и его друзей построения LCP
     LCP_.resize(size_ - 1);
-    std::vector<int> position(size_);
+    std::vector<Index> position(size_);
 
     // строим симметричный суффиксному массиву массив для удобства
     for (size_t i = 0; i < size_; ++i) {
@@ -165,8 +851,9 @@ void SuffixArray::buildLCPUsingKasai() {
             // То сравним текущую строку со следующей по порядку в суффиксном массиве
             size_t j = suffix_array_[position[i] + 1];
 
-            // И найдём в них количество повторяющихся символов
-            while (std::max(i + n_of_similar_symbols, j + n_of_similar_symbols) < size_
+            // И найдём в них количество повторяющихся символов. Последний символ ('$') единственный в своём роде
+            // и ни с чем не совпадает, даже если такой же байт встречается в тексте
+            while (std::max(i + n_of_similar_symbols, j + n_of_similar_symbols) < size_ - 1
                    && text_[i + n_of_similar_symbols] == text_[j + n_of_similar_symbols]) {
                 ++n_of_similar_symbols;
             }
@@ -177,33 +864,1260 @@ void SuffixArray::buildLCPUsingKasai() {
 
 }
 
-size_t SuffixArray::calcDifferentSubstrings() {
-    if (LCP_.empty()) {
-        buildLCPUsingKasai();
-    }
+template<class Index, class Symbol>
+void SuffixArray<Index, Symbol>::buildLCPUsingPhi() {
+    // LCP через Φ-массив (Kärkkäinen, Manzini, Puglisi): Φ[suffix_array_[p]] = suffix_array_[p + 1],
+    // PLCP[i] = lcp(i, Φ[i]) считается в порядке позиций текста, и как у Касаи PLCP[i + 1] >= PLCP[i] - 1.
+    // Позиции текста делятся на куски по потокам, в начале куска счётчик совпадающих символов начинается с нуля,
+    // то есть каждый поток переделывает не больше одного сравнения. PLCP пишется на место Φ,
+    // потом LCP_[p] = PLCP[suffix_array_[p]]. Даже в один поток это быстрее Касаи: text_ читается подряд.
+    const Index NONE = std::numeric_limits<Index>::max();
+    std::vector<Index> phi(size_);
 
-    // Вспомним, что мы добавили к нашей строке '$', и вычтем 1 из размера строки для удобства расчета
-    --size_;
+    runInThreads(n_of_threads_, [this, &phi, NONE](size_t t) {
+        for (size_t p = chunkBegin(size_, n_of_threads_, t); p < chunkBegin(size_, n_of_threads_, t + 1); ++p) {
+            phi[suffix_array_[p]] = p + 1 < size_ ? suffix_array_[p + 1] : NONE;
+        }
+    });
+
+    runInThreads(n_of_threads_, [this, &phi, NONE](size_t t) {
+        size_t n_of_similar_symbols = 0;
+        for (size_t i = chunkBegin(size_, n_of_threads_, t); i < chunkBegin(size_, n_of_threads_, t + 1); ++i) {
+            if (phi[i] == NONE) {
+                n_of_similar_symbols = 0;
+                phi[i] = 0;
+                continue;
+            }
+
+            size_t j = phi[i];
+            while (std::max(i + n_of_similar_symbols, j + n_of_similar_symbols) < size_ - 1
+                   && text_[i + n_of_similar_symbols] == text_[j + n_of_similar_symbols]) {
+                ++n_of_similar_symbols;
+            }
+            phi[i] = n_of_similar_symbols;
+
+            if (n_of_similar_symbols > 0) {
+                --n_of_similar_symbols;
+            }
+        }
+    });
+
+    LCP_.resize(size_ - 1);
+    runInThreads(n_of_threads_, [this, &phi](size_t t) {
+        for (size_t p = chunkBegin(size_ - 1, n_of_threads_, t); p < chunkBegin(size_ - 1, n_of_threads_, t + 1); ++p) {
+            LCP_[p] = phi[suffix_array_[p]];
+        }
+    });
+}
 
+// Число различных подстрок строки длины size по её LCP (size чисел, первый - для суффикса "$")
+template<class LCPArray>
+size_t countDifferentSubstrings(const LCPArray & LCP, size_t size) {
     // Если бы все подстроки априори бы ли бы различными, то их число просто выражалось бы такой формулой
-    size_t result = (size_ + 1) * size_ / 2;
+    size_t result = (size + 1) * size / 2;
 
     // Но так как подстроки могут быть префиксами друг друга, учтем количество повторений подстрок,
     // то есть количество совпадающих символов для каждой подстроки.
     // Для этого вычтем из результата сумму всего LCP
-    for (size_t i = 0; i < size_; ++i) {
-        result -= LCP_[i];
+    for (size_t i = 0; i < size; ++i) {
+        result -= LCP[i];
     }
 
     return result;
 }
 
+template<class Index, class Symbol>
+size_t SuffixArray<Index, Symbol>::calcDifferentSubstrings() {
+    if (LCP_.empty()) {
+        buildLCPUsingPhi();
+    }
 
-int main() {
-    std::string text;
-    std::cin >> text;
+    // Вспомним, что мы добавили к нашей строке '$', и вычтем 1 из размера строки для удобства расчета
+    return countDifferentSubstrings(LCP_, size_ - 1);
+}
+
+template<class Index, class Symbol>
+void SuffixArray<Index, Symbol>::buildLCE() {
+    if (LCP_.empty()) {
+        buildLCPUsingPhi();
+    }
+
+    rank_.resize(size_);
+    runInThreads(n_of_threads_, [this](size_t t) {
+        for (size_t p = chunkBegin(size_, n_of_threads_, t); p < chunkBegin(size_, n_of_threads_, t + 1); ++p) {
+            rank_[suffix_array_[p]] = p;
+        }
+    });
+    LCP_range_min_ = RangeMin(LCP_.data(), LCP_.size());
+}
+
+template<class Index, class Symbol>
+size_t SuffixArray<Index, Symbol>::longestCommonExtension(size_t i, size_t j) const {
+    // lcp суффиксов - минимум LCP_ между их позициями в суффиксном массиве
+    assert(rank_.size() == size_ && "buildLCE() must be called first");
+    if (i == j) {
+        return size_ - 1 - i;
+    }
+    size_t left = rank_[i];
+    size_t right = rank_[j];
+    if (left > right) {
+        std::swap(left, right);
+    }
+    return LCP_range_min_.query(LCP_.data(), left, right - 1);
+}
+
+template<class Index, class Symbol>
+std::vector<typename SuffixArray<Index, Symbol>::LZFactor> SuffixArray<Index, Symbol>::factorizeLZ77() const {
+    // Как в KKP3 (Kärkkäinen, Kempa, Puglisi): для каждой позиции i ближайшие к ней в суффиксном массиве
+    // суффиксы, начинающиеся левее, - PSV (слева) и NSV (справа). Самое длинное совпадение с более ранней
+    // позицией достигается на одном из них. PSV и NSV считаются одним проходом по suffix_array_ со стеком
+    // возрастающих позиций. Длины фраз считаются прямым сравнением: на фразу длины l уходит O(l) сравнений,
+    // в сумме O(n).
+    const Index NONE = std::numeric_limits<Index>::max();
+    const size_t length = size_ - 1;
+    std::vector<Index> previous_smaller(length);
+    std::vector<Index> next_smaller(length);
+
+    std::vector<Index> stack;
+    for (size_t p = 0; p <= size_; ++p) {
+        // Суффикс "$" (позиция length) больше всех остальных позиций и сразу выталкивается, за концом - "-1"
+        Index position = p < size_ ? suffix_array_[p] : NONE;
+        while (!stack.empty() && (position == NONE || stack.back() > position)) {
+            Index top = stack.back();
+            stack.pop_back();
+            if (top < length) {
+                next_smaller[top] = position;
+                previous_smaller[top] = stack.empty() ? NONE : stack.back();
+            }
+        }
+        if (position != NONE) {
+            stack.push_back(position);
+        }
+    }
+
+    auto match = [this, length, NONE](size_t i, Index j) {
+        size_t n_of_similar_symbols = 0;
+        if (j != NONE) {
+            while (i + n_of_similar_symbols < length && text_[i + n_of_similar_symbols] == text_[j + n_of_similar_symbols]) {
+                ++n_of_similar_symbols;
+            }
+        }
+        return n_of_similar_symbols;
+    };
+
+    std::vector<LZFactor> factors;
+    for (size_t i = 0; i < length;) {
+        size_t previous_match = match(i, previous_smaller[i]);
+        size_t next_match = match(i, next_smaller[i]);
+        if (previous_match == 0 && next_match == 0) {
+            factors.push_back({static_cast<Index>(text_[i]), 0});
+            ++i;
+            continue;
+        }
+        if (previous_match >= next_match) {
+            factors.push_back({previous_smaller[i], static_cast<Index>(previous_match)});
+        } else {
+            factors.push_back({next_smaller[i], static_cast<Index>(next_match)});
+        }
+        i += std::max(previous_match, next_match);
+    }
+    return factors;
+}
+
+template<class Index, class Symbol>
+size_t SuffixArray<Index, Symbol>::leftSymbol(size_t p) const {
+    return suffix_array_[p] == 0 ? NO_LEFT_SYMBOL : static_cast<size_t>(text_[suffix_array_[p] - 1]);
+}
+
+template<class Index, class Symbol>
+template<class Callback>
+void SuffixArray<Index, Symbol>::forEachLCPInterval(Callback on_interval) {
+    if (LCP_.empty()) {
+        buildLCPUsingPhi();
+    }
+
+    // Обход Абуэлхода, Курца, Охлебуша: стек открытых интервалов с возрастающим lcp.
+    // lcp суффиксов p - 1 и p - это LCP_[p - 1], за концом массива - 0, чтобы закрыть все интервалы.
+    // Закрытый интервал - ребёнок либо интервала под ним на стеке, либо того, который сейчас откроется.
+    struct Interval {
+        size_t lcp;
+        size_t left;
+        bool has_child;
+    };
+    std::vector<Interval> stack = {{0, 0, false}};
+    for (size_t p = 1; p <= size_; ++p) {
+        size_t lcp = p < size_ ? LCP_[p - 1] : 0;
+        size_t left = p - 1;
+        bool closed_child = false;
+        while (lcp < stack.back().lcp) {
+            Interval interval = stack.back();
+            stack.pop_back();
+            on_interval(interval.lcp, interval.left, p - 1, interval.has_child);
+            left = interval.left;
+            closed_child = true;
+            if (lcp <= stack.back().lcp) {
+                stack.back().has_child = true;
+                closed_child = false;
+            }
+        }
+        if (lcp > stack.back().lcp) {
+            stack.push_back({lcp, left, closed_child});
+        }
+    }
+}
+
+template<class Index, class Symbol>
+std::vector<typename SuffixArray<Index, Symbol>::Repeat> SuffixArray<Index, Symbol>::findMaximalRepeats(size_t min_length) {
+    // lcp-интервал - это ровно правомаксимальный повтор. Он левомаксимален, если символы перед его
+    // вхождениями (символы BWT) не все одинаковы. left_changes[p] - число смен символа BWT на [1, p],
+    // суффикс всего текста считаем отличающимся от соседей.
+    std::vector<Index> left_changes(size_);
+    for (size_t p = 1; p < size_; ++p) {
+        size_t symbol = leftSymbol(p);
+        size_t previous_symbol = leftSymbol(p - 1);
+        bool changed = symbol == NO_LEFT_SYMBOL || previous_symbol == NO_LEFT_SYMBOL || symbol != previous_symbol;
+        left_changes[p] = left_changes[p - 1] + changed;
+    }
+
+    std::vector<Repeat> repeats;
+    forEachLCPInterval([this, min_length, &left_changes, &repeats](size_t lcp, size_t left, size_t right, bool) {
+        if (lcp >= min_length && left_changes[right] != left_changes[left]) {
+            repeats.push_back({suffix_array_[left], static_cast<Index>(lcp), static_cast<Index>(right - left + 1)});
+        }
+    });
+    return repeats;
+}
+
+template<class Index, class Symbol>
+std::vector<typename SuffixArray<Index, Symbol>::Repeat> SuffixArray<Index, Symbol>::findSupermaximalRepeats(size_t min_length) {
+    // Повтор супермаксимален, если его lcp-интервал не содержит вложенных интервалов
+    // и символы перед всеми вхождениями попарно различны. Такой интервал не длиннее алфавита + 1.
+    std::vector<Repeat> repeats;
+    std::vector<size_t> left_symbols;
+    forEachLCPInterval([this, min_length, &left_symbols, &repeats](size_t lcp, size_t left, size_t right, bool has_child) {
+        if (lcp < min_length || has_child) {
+            return;
+        }
+        left_symbols.clear();
+        for (size_t p = left; p <= right; ++p) {
+            left_symbols.push_back(leftSymbol(p));
+        }
+        std::sort(left_symbols.begin(), left_symbols.end());
+        if (std::adjacent_find(left_symbols.begin(), left_symbols.end()) == left_symbols.end()) {
+            repeats.push_back({suffix_array_[left], static_cast<Index>(lcp), static_cast<Index>(right - left + 1)});
+        }
+    });
+    return repeats;
+}
+
+template<class Index, class Symbol>
+Index SuffixArray<Index, Symbol>::fillLCPLR(long left, long right) {
+    // Бинпоиск по суффиксному массиву всегда идёт по одному и тому же дереву отрезков (left, right),
+    // начиная с (-1, size_), где -1 и size_ - воображаемые суффиксы меньше и больше всех.
+    // Для середины middle каждого отрезка запоминаем lcp(left, middle) и lcp(middle, right),
+    // функция возвращает lcp(left, right) = min(LCP_[left ... right - 1]) (0 для воображаемых суффиксов).
+    bool is_real = left >= 0 && right < static_cast<long>(size_);
+
+    if (right - left == 1) {
+        return is_real ? LCP_[left] : 0;
+    }
+
+    long middle = left + (right - left) / 2;
+    LCP_LR_[middle].left = fillLCPLR(left, middle);
+    LCP_LR_[middle].right = fillLCPLR(middle, right);
+
+    return is_real ? std::min(LCP_LR_[middle].left, LCP_LR_[middle].right) : 0;
+}
+
+template<class Index, class Symbol>
+void SuffixArray<Index, Symbol>::buildLCPLR() {
+    if (LCP_.empty()) {
+        buildLCPUsingPhi();
+    }
+
+    LCP_LR_.resize(size_);
+    fillLCPLR(-1, size_);
+}
+
+template<class Index, class Symbol>
+long SuffixArray<Index, Symbol>::findBound(const Text & pattern, Bound & bound, bool is_prefix_less, bool stop_at_pattern) const {
+    // Бинпоиск Манбера–Майерса: в bound.right - первый суффикс, который больше pattern. Суффикс, начинающийся с pattern,
+    // считается больше, если is_prefix_less == false (нижняя граница), и меньше - иначе (верхняя граница).
+    //
+    // Храним left_match = lcp(pattern, left) и right_match = lcp(pattern, right). Если, например,
+    // left_match >= right_match и lcp(left, middle) != left_match, то middle сравнивается с pattern
+    // без чтения текста, а иначе сравнение начинается сразу с символа left_match.
+    // Так каждый символ pattern совпадает не больше одного раза, и поиск работает за O(p + log n).
+    //
+    // Если stop_at_pattern, поиск останавливается на первой середине, которая начинается с pattern,
+    // и возвращает её (-1, если такой не встретилось): до неё поиски обеих границ идут одинаково.
+    TextSymbols<Symbol> symbols{text_.data(), size_ - 1};
+    const size_t pattern_size = pattern.size();
+
+    long & left = bound.left;
+    long & right = bound.right;
+    size_t & left_match = bound.left_match;
+    size_t & right_match = bound.right_match;
+
+    while (right - left > 1) {
+        long middle = left + (right - left) / 2;
+        size_t match = std::max(left_match, right_match);
+
+        if (left_match >= right_match) {
+            // middle и left совпадают дальше, чем pattern и left, значит middle с той же стороны от pattern, что и left
+            if (static_cast<size_t>(LCP_LR_[middle].left) > left_match) {
+                left = middle;
+                continue;
+            }
+            // middle отличается от left раньше, чем pattern, значит middle больше pattern
+            if (static_cast<size_t>(LCP_LR_[middle].left) < left_match) {
+                right = middle;
+                right_match = LCP_LR_[middle].left;
+                continue;
+            }
+        }
+        else {
+            if (static_cast<size_t>(LCP_LR_[middle].right) > right_match) {
+                right = middle;
+                continue;
+            }
+            if (static_cast<size_t>(LCP_LR_[middle].right) < right_match) {
+                left = middle;
+                left_match = LCP_LR_[middle].right;
+                continue;
+            }
+        }
+
+        // Сравниваем символы с match; '$' (символ 0) не совпадает ни с одним символом pattern
+        size_t suffix = suffix_array_[middle];
+        while (match < pattern_size && symbols[suffix + match] == static_cast<size_t>(pattern[match]) + 1) {
+            ++match;
+        }
+
+        if (match == pattern_size && stop_at_pattern) {
+            return middle;
+        }
+
+        bool is_middle_less = match == pattern_size ? is_prefix_less
+                                                    : symbols[suffix + match] < static_cast<size_t>(pattern[match]) + 1;
+        if (is_middle_less) {
+            left = middle;
+            left_match = match;
+        }
+        else {
+            right = middle;
+            right_match = match;
+        }
+    }
+
+    return -1;
+}
+
+template<class Index, class Symbol>
+std::pair<size_t, size_t> SuffixArray<Index, Symbol>::findRange(const Text & pattern) const {
+    Bound lower{-1, static_cast<long>(size_), 0, 0};
+    long middle = findBound(pattern, lower, false, true);
+    if (middle < 0) {
+        // pattern не встречается
+        return {lower.right, lower.right};
+    }
+
+    // Суффикс middle начинается с pattern: нижняя граница слева от него, верхняя - справа
+    Bound upper = lower;
+    lower.right = middle;
+    lower.right_match = pattern.size();
+    upper.left = middle;
+    upper.left_match = pattern.size();
+
+    findBound(pattern, lower, false, false);
+    findBound(pattern, upper, true, false);
+    return {lower.right, upper.right};
+}
+
+template<class Index, class Symbol>
+size_t SuffixArray<Index, Symbol>::count(const Text & pattern) {
+    if (LCP_LR_.empty()) {
+        buildLCPLR();
+    }
+
+    auto range = findRange(pattern);
+    return range.second - range.first;
+}
+
+template<class Index, class Symbol>
+std::vector<Index> SuffixArray<Index, Symbol>::locate(const Text & pattern) {
+    if (LCP_LR_.empty()) {
+        buildLCPLR();
+    }
+
+    auto range = findRange(pattern);
+    return std::vector<Index>(suffix_array_.begin() + range.first, suffix_array_.begin() + range.second);
+}
+
+template<class Index, class Symbol>
+template<class Callback>
+void SuffixArray<Index, Symbol>::findRanges(const std::vector<Text> & patterns, Callback on_range) {
+    // Шаблоны обрабатываются в порядке первых 8 байт: соседние бинпоиски проходят почти по одним
+    // и тем же элементам суффиксного массива, и они остаются в кэше. Сортировать шаблоны целиком
+    // дороже, а верх дерева бинпоиска и так определяется первыми символами.
+    // Отсортированный список делится на куски по потокам.
+    if (LCP_LR_.empty()) {
+        buildLCPLR();
+    }
+
+    const size_t SYMBOL_BITS = 8 * sizeof(Symbol);
+    std::vector<std::pair<uint64_t, size_t>> order(patterns.size());
+    for (size_t i = 0; i < order.size(); ++i) {
+        uint64_t prefix = 0;
+        for (size_t k = 0; k < 64 / SYMBOL_BITS; ++k) {
+            prefix = (prefix << SYMBOL_BITS) | (k < patterns[i].size() ? static_cast<uint64_t>(patterns[i][k]) : 0);
+        }
+        order[i] = {prefix, i};
+    }
+    std::sort(order.begin(), order.end());
+
+    size_t n_of_threads = std::min(n_of_threads_, std::max<size_t>(1, patterns.size()));
+    runInThreads(n_of_threads, [&](size_t t) {
+        for (size_t k = chunkBegin(order.size(), n_of_threads, t); k < chunkBegin(order.size(), n_of_threads, t + 1); ++k) {
+            size_t i = order[k].second;
+            on_range(i, findRange(patterns[i]));
+        }
+    });
+}
+
+template<class Index, class Symbol>
+std::vector<size_t> SuffixArray<Index, Symbol>::count(const std::vector<Text> & patterns) {
+    std::vector<size_t> result(patterns.size());
+    findRanges(patterns, [&result](size_t i, std::pair<size_t, size_t> range) {
+        result[i] = range.second - range.first;
+    });
+    return result;
+}
+
+template<class Index, class Symbol>
+std::vector<std::vector<Index>> SuffixArray<Index, Symbol>::locate(const std::vector<Text> & patterns) {
+    std::vector<std::vector<Index>> result(patterns.size());
+    findRanges(patterns, [this, &result](size_t i, std::pair<size_t, size_t> range) {
+        result[i].assign(suffix_array_.begin() + range.first, suffix_array_.begin() + range.second);
+    });
+    return result;
+}
+
+// Массив чисел по width бит, записанных подряд в 64-битные слова (младшие биты - раньше).
+// В конце всегда есть лишнее слово, чтобы число на стыке слов читалось без проверки границы.
+class PackedArray {
+private:
+    const uint64_t * words_ = nullptr;
+    int width_ = 0;
+    uint64_t mask_ = 0;
+
+public:
+    PackedArray() = default;
+    PackedArray(const uint64_t * words, int width) : words_(words), width_(width), mask_(width == 64 ? ~0ull : (1ull << width) - 1) {}
+
+    uint64_t operator[](size_t i) const {
+        size_t bit = i * width_;
+        size_t word = bit >> 6u;
+        size_t offset = bit & 63u;
+
+        uint64_t value = words_[word] >> offset;
+        if (offset + width_ > 64) {
+            value |= words_[word + 1] << (64 - offset);
+        }
+        return value & mask_;
+    }
+
+    static size_t wordsFor(size_t size, int width) {
+        return (size * width + 63) / 64 + 1;
+    }
+
+    // Упаковывает values[0], values[step], values[2 * step], ... по width бит
+    template<class Value>
+    static std::vector<uint64_t> pack(const std::vector<Value> & values, size_t step, int width) {
+        size_t size = (values.size() + step - 1) / step;
+        std::vector<uint64_t> words(wordsFor(size, width), 0);
+
+        for (size_t i = 0; i < size; ++i) {
+            uint64_t value = values[i * step];
+            size_t bit = i * width;
+            size_t word = bit >> 6u;
+            size_t offset = bit & 63u;
+
+            words[word] |= value << offset;
+            if (offset + width > 64) {
+                words[word + 1] |= value >> (64 - offset);
+            }
+        }
+        return words;
+    }
+};
+
+class MappedFile {
+private:
+    const char * data_ = nullptr;
+    size_t size_ = 0;
+
+public:
+    explicit MappedFile(const std::string & filename) {
+        int fd = open(filename.c_str(), O_RDONLY);
+        if (fd < 0) {
+            perror(filename.c_str());
+            return;
+        }
+
+        struct stat file_stat{};
+        if (fstat(fd, &file_stat) == 0 && file_stat.st_size > 0) {
+            void * data = mmap(nullptr, file_stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (data != MAP_FAILED) {
+                data_ = static_cast<const char*>(data);
+                size_ = file_stat.st_size;
+                madvise(data, size_, MADV_SEQUENTIAL);
+            }
+            else {
+                perror(filename.c_str());
+            }
+        }
+        close(fd);
+    }
+    ~MappedFile() {
+        if (data_ != nullptr) {
+            munmap(const_cast<char*>(data_), size_);
+        }
+    }
+    MappedFile(const MappedFile &) = delete;
+    MappedFile & operator=(const MappedFile &) = delete;
+
+    const char * data() const {
+        return data_;
+    }
+    size_t size() const {
+        return size_;
+    }
+};
+
+// Формат файла индекса (порядок байт - как в памяти машины, каждая часть выровнена на 8 байт):
+//   SuffixArrayIndexHeader,
+//   text_ (size байт, вместе с '$'), дополненный нулями,
+//   suffix_array_[0], suffix_array_[s], suffix_array_[2s], ... по sa_width бит, где s = sa_sample_rate,
+//   LCP_ (size - 1 чисел по lcp_width бит).
+// Для двух строк (задача F) text_ = text1 + '$' + text2 + '#', first_string_size = |text1| + 1.
+struct SuffixArrayIndexHeader {
+    char magic[4];
+    uint32_t version;
+    uint64_t size;
+    uint32_t sa_width;
+    uint32_t lcp_width;
+    uint32_t sa_sample_rate;
+    uint32_t n_of_strings;
+    uint64_t first_string_size;
+};
+
+const char SUFFIX_ARRAY_INDEX_MAGIC[4] = {'S', 'A', 'I', 'X'};
+const uint32_t SUFFIX_ARRAY_INDEX_VERSION = 1;
+
+size_t alignTo8(size_t size) {
+    return (size + 7) & ~size_t(7);
+}
+
+template<class Index, class Symbol>
+bool SuffixArray<Index, Symbol>::save(const std::string & filename, size_t sa_sample_rate) {
+    static_assert(sizeof(Symbol) == 1, "index file stores the text as bytes");
+
+    if (LCP_.empty()) {
+        buildLCPUsingPhi();
+    }
+
+    std::ofstream file(filename, std::ios_base::out | std::ios_base::trunc | std::ios_base::binary);
+    if (!file) {
+        perror(filename.c_str());
+        return false;
+    }
+
+    SuffixArrayIndexHeader header{};
+    memcpy(header.magic, SUFFIX_ARRAY_INDEX_MAGIC, sizeof(header.magic));
+    header.version = SUFFIX_ARRAY_INDEX_VERSION;
+    header.size = size_;
+    header.sa_width = bitWidth(size_ - 1);
+    header.lcp_width = bitWidth(LCP_.empty() ? 0 : *std::max_element(LCP_.begin(), LCP_.end()));
+    header.sa_sample_rate = std::max<size_t>(1, sa_sample_rate);
+    header.n_of_strings = 1;
+    header.first_string_size = size_;
+
+    std::string padded_text(text_.begin(), text_.end());
+    padded_text.resize(alignTo8(padded_text.size()), '\0');
+    auto suffix_array_words = PackedArray::pack(suffix_array_, header.sa_sample_rate, header.sa_width);
+    auto LCP_words = PackedArray::pack(LCP_, 1, header.lcp_width);
+
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.write(padded_text.data(), padded_text.size());
+    file.write(reinterpret_cast<const char*>(suffix_array_words.data()), suffix_array_words.size() * sizeof(uint64_t));
+    file.write(reinterpret_cast<const char*>(LCP_words.data()), LCP_words.size() * sizeof(uint64_t));
+
+    return static_cast<bool>(file);
+}
+
+// Суффиксный массив и LCP, записанные SuffixArray::save(). Файл отображается в память,
+// части индекса читаются прямо из него, поэтому открытие не зависит от длины текста.
+class SuffixArrayIndex {
+private:
+    MappedFile file_;
+    const SuffixArrayIndexHeader * header_ = nullptr;
+    PackedArray suffix_array_samples_;
+    PackedArray LCP_;
+
+public:
+    explicit SuffixArrayIndex(const std::string & filename);
+
+    bool isOpen() const {
+        return header_ != nullptr;
+    }
+
+    // Размер текста вместе с '$'
+    size_t size() const {
+        return header_->size;
+    }
+
+    size_t calcDifferentSubstrings() const {
+        return countDifferentSubstrings(LCP_, size() - 1);
+    }
+
+    void printInfo(std::ostream & log_stream) const {
+        log_stream << "Text: " << size() - 1 << " symbols\n";
+        log_stream << "Suffix array: " << header_->sa_width << " bits, every " << header_->sa_sample_rate << " element\n";
+        log_stream << "LCP: " << header_->lcp_width << " bits\n";
+        log_stream << "File: " << file_.size() << " bytes" << std::endl;
+    }
+};
+
+SuffixArrayIndex::SuffixArrayIndex(const std::string & filename) : file_(filename) {
+    const char * data = file_.data();
+    size_t size = file_.size();
+
+    const auto * header = reinterpret_cast<const SuffixArrayIndexHeader*>(data);
+    if (size < sizeof(SuffixArrayIndexHeader) || memcmp(header->magic, SUFFIX_ARRAY_INDEX_MAGIC, sizeof(header->magic)) != 0
+        || header->version != SUFFIX_ARRAY_INDEX_VERSION || header->size == 0 || header->size > size
+        || header->sa_sample_rate == 0 || header->sa_width > 32 || header->lcp_width > 32) {
+        return;
+    }
+
+    size_t n_of_samples = (header->size + header->sa_sample_rate - 1) / header->sa_sample_rate;
+    size_t text_offset = sizeof(SuffixArrayIndexHeader);
+    size_t suffix_array_offset = text_offset + alignTo8(header->size);
+    size_t LCP_offset = suffix_array_offset + PackedArray::wordsFor(n_of_samples, header->sa_width) * sizeof(uint64_t);
+    size_t end = LCP_offset + PackedArray::wordsFor(header->size - 1, header->lcp_width) * sizeof(uint64_t);
+    if (end > size) {
+        return;
+    }
+
+    header_ = header;
+    suffix_array_samples_ = PackedArray(reinterpret_cast<const uint64_t*>(data + suffix_array_offset), header->sa_width);
+    LCP_ = PackedArray(reinterpret_cast<const uint64_t*>(data + LCP_offset), header->lcp_width);
+}
+
+
+
+// Битовый вектор с rank: на каждые 512 бит хранится число единиц до них (+12.5% памяти),
+// rank1 - сумма этого числа и popcount не больше чем 8 слов
+class RankBitVector {
+private:
+    std::vector<uint64_t> words_;
+    std::vector<uint64_t> block_ranks_;
+
+public:
+    RankBitVector() = default;
+    // Лишнее слово в конце, чтобы rank1(size) не выходил за границу
+    explicit RankBitVector(size_t size) : words_(size / 64 + 1, 0) {}
+
+    void set(size_t i) {
+        words_[i >> 6u] |= 1ull << (i & 63u);
+    }
+    bool operator[](size_t i) const {
+        return (words_[i >> 6u] >> (i & 63u)) & 1u;
+    }
+
+    void buildRank() {
+        block_ranks_.assign(words_.size() / 8 + 1, 0);
+        uint64_t rank = 0;
+        for (size_t w = 0; w < words_.size(); ++w) {
+            if (w % 8 == 0) {
+                block_ranks_[w / 8] = rank;
+            }
+            rank += __builtin_popcountll(words_[w]);
+        }
+    }
+
+    // Число единиц на [0, i)
+    size_t rank1(size_t i) const {
+        size_t word = i >> 6u;
+        size_t result = block_ranks_[word >> 3u];
+        for (size_t w = word & ~size_t(7); w < word; ++w) {
+            result += __builtin_popcountll(words_[w]);
+        }
+        return result + __builtin_popcountll(words_[word] & ((1ull << (i & 63u)) - 1));
+    }
+
+    size_t memoryUsage() const {
+        return (words_.size() + block_ranks_.size()) * sizeof(uint64_t);
+    }
+};
+
+// Wavelet matrix (Claude, Navarro): уровень l хранит l-й сверху бит символов, символы на следующем уровне
+// устойчиво переставлены - сначала с нулевым битом, потом с единичным. rank и access - за O(log σ) rank1.
+class WaveletMatrix {
+private:
+    size_t size_ = 0;
+    int n_of_levels_ = 0;
+    std::vector<RankBitVector> levels_;
+    std::vector<size_t> zeros_;
+    // bottom_starts_[c] - начало символов c на нижнем уровне
+    std::vector<size_t> bottom_starts_;
+
+public:
+    WaveletMatrix() = default;
+    WaveletMatrix(std::vector<uint16_t> symbols, size_t alphabet_size) : size_(symbols.size()),
+                                                                         n_of_levels_(std::max(1, bitWidth(alphabet_size - 1))) {
+        std::vector<uint16_t> next(size_);
+        for (int l = 0; l < n_of_levels_; ++l) {
+            int shift = n_of_levels_ - 1 - l;
+            levels_.emplace_back(size_);
+
+            size_t n_of_zeros = 0;
+            for (size_t i = 0; i < size_; ++i) {
+                if ((symbols[i] >> shift) & 1u) {
+                    levels_[l].set(i);
+                }
+                else {
+                    ++n_of_zeros;
+                }
+            }
+            levels_[l].buildRank();
+            zeros_.push_back(n_of_zeros);
+
+            size_t zero = 0;
+            size_t one = n_of_zeros;
+            for (size_t i = 0; i < size_; ++i) {
+                next[((symbols[i] >> shift) & 1u) ? one++ : zero++] = symbols[i];
+            }
+            symbols.swap(next);
+        }
+
+        bottom_starts_.resize(alphabet_size);
+        for (size_t c = 0; c < alphabet_size; ++c) {
+            bottom_starts_[c] = descend(c, 0);
+        }
+    }
+
+    // Позиция на нижнем уровне, куда попадает i-й элемент, если бы в нём был символ c
+    size_t descend(size_t c, size_t i) const {
+        for (int l = 0; l < n_of_levels_; ++l) {
+            size_t rank1 = levels_[l].rank1(i);
+            i = ((c >> (n_of_levels_ - 1 - l)) & 1u) ? zeros_[l] + rank1 : i - rank1;
+        }
+        return i;
+    }
+
+    // Число символов c на [0, i)
+    size_t rank(size_t c, size_t i) const {
+        return descend(c, i) - bottom_starts_[c];
+    }
+
+    // Символ i и число таких же символов на [0, i)
+    std::pair<size_t, size_t> accessAndRank(size_t i) const {
+        size_t c = 0;
+        for (int l = 0; l < n_of_levels_; ++l) {
+            bool bit = levels_[l][i];
+            size_t rank1 = levels_[l].rank1(i);
+            c = (c << 1u) | bit;
+            i = bit ? zeros_[l] + rank1 : i - rank1;
+        }
+        return {c, i - bottom_starts_[c]};
+    }
+
+    size_t memoryUsage() const {
+        size_t result = (zeros_.size() + bottom_starts_.size()) * sizeof(size_t);
+        for (auto & level : levels_) {
+            result += level.memoryUsage();
+        }
+        return result;
+    }
+};
+
+// Сжатый полнотекстовый индекс (Ferragina, Manzini) по суффиксному массиву: BWT в wavelet matrix,
+// suffix_array_[i] хранится, только если делится на sample_rate, и обратный массив - для позиций, кратных sample_rate.
+// Текст и суффиксный массив после построения не нужны.
+//   count   - обратный поиск, O(p log σ);
+//   locate  - для каждого вхождения не больше sample_rate шагов LF до сохранённого элемента;
+//   extract - от сохранённой позиции за концом отрезка LF идёт назад по тексту, O((length + sample_rate) log σ).
+class FMIndex {
+private:
+    size_t size_;
+    size_t sample_rate_;
+    // Символы сжаты до алфавита текста: '$' - 0, остальные байты текста - 1, 2, ... в порядке возрастания
+    int codes_[256];
+    std::vector<char> symbols_;
+    // C_[c] - число символов текста меньше c
+    std::vector<size_t> C_;
+    WaveletMatrix BWT_;
+
+    RankBitVector is_sampled_;
+    std::vector<uint64_t> samples_;
+    std::vector<uint64_t> inverse_samples_;
+    int sample_width_;
+
+    size_t LF(size_t i, size_t & c) const {
+        auto symbol_rank = BWT_.accessAndRank(i);
+        c = symbol_rank.first;
+        return C_[c] + symbol_rank.second;
+    }
+
+    std::pair<size_t, size_t> findRange(const std::string & pattern) const;
+
+public:
+    // Строится по суффиксному массиву байтового текста
+    FMIndex(const SuffixArray<> & suffix_array, size_t sample_rate);
+
+    size_t count(const std::string & pattern) const {
+        auto range = findRange(pattern);
+        return range.second - range.first;
+    }
+    // Позиции вхождений в порядке суффиксного массива, как у SuffixArray::locate
+    std::vector<uint32_t> locate(const std::string & pattern) const;
+    // text[start ... start + length - 1]
+    std::string extract(size_t start, size_t length) const;
+
+    size_t memoryUsage() const {
+        return sizeof(*this) + symbols_.size() + C_.size() * sizeof(size_t) + BWT_.memoryUsage() + is_sampled_.memoryUsage()
+               + (samples_.size() + inverse_samples_.size()) * sizeof(uint64_t);
+    }
+
+    void printInfo(std::ostream & log_stream) const {
+        log_stream << "FM-index: " << size_ - 1 << " symbols, alphabet " << symbols_.size() << ", sample rate " << sample_rate_ << "\n";
+        log_stream << "Memory: " << memoryUsage() << " bytes, " << 8.0 * memoryUsage() / std::max<size_t>(1, size_ - 1)
+                   << " bits per symbol" << std::endl;
+    }
+};
+
+FMIndex::FMIndex(const SuffixArray<> & suffix_array, size_t sample_rate) : size_(suffix_array.size_),
+                                                                        sample_rate_(std::max<size_t>(1, sample_rate)),
+                                                                        codes_(), is_sampled_(suffix_array.size_) {
+    const auto & text = suffix_array.text_;
+    const auto & SA = suffix_array.suffix_array_;
+
+    // Сжатие алфавита; последний символ text ('$') - всегда 0
+    std::vector<size_t> n_of_symbols(256, 0);
+    for (size_t i = 0; i + 1 < size_; ++i) {
+        ++n_of_symbols[text[i]];
+    }
+    symbols_.push_back('$');
+    C_.push_back(0);
+    size_t n_of_smaller = 1;
+    for (size_t c = 0; c < 256; ++c) {
+        codes_[c] = -1;
+        if (n_of_symbols[c] > 0) {
+            codes_[c] = symbols_.size();
+            symbols_.push_back(static_cast<char>(c));
+            C_.push_back(n_of_smaller);
+            n_of_smaller += n_of_symbols[c];
+        }
+    }
+
+    // BWT[i] - символ перед суффиксом suffix_array_[i]
+    std::vector<uint16_t> BWT(size_);
+    for (size_t i = 0; i < size_; ++i) {
+        size_t j = SA[i] == 0 ? size_ - 1 : SA[i] - 1;
+        BWT[i] = j == size_ - 1 ? 0 : codes_[text[j]];
+    }
+    BWT_ = WaveletMatrix(std::move(BWT), symbols_.size());
+
+    std::vector<uint32_t> samples;
+    std::vector<uint32_t> inverse_samples((size_ + sample_rate_ - 1) / sample_rate_);
+    for (size_t i = 0; i < size_; ++i) {
+        if (SA[i] % sample_rate_ == 0) {
+            is_sampled_.set(i);
+            samples.push_back(SA[i]);
+            inverse_samples[SA[i] / sample_rate_] = i;
+        }
+    }
+    is_sampled_.buildRank();
+
+    sample_width_ = bitWidth(size_ - 1);
+    samples_ = PackedArray::pack(samples, 1, sample_width_);
+    inverse_samples_ = PackedArray::pack(inverse_samples, 1, sample_width_);
+}
+
+std::pair<size_t, size_t> FMIndex::findRange(const std::string & pattern) const {
+    // Обратный поиск: [begin, end) - суффиксы, начинающиеся с pattern[k ... p - 1]
+    size_t begin = 0;
+    size_t end = size_;
+    for (size_t k = pattern.size(); k > 0 && begin < end; --k) {
+        int c = codes_[static_cast<unsigned char>(pattern[k - 1])];
+        if (c < 0) {
+            return {0, 0};
+        }
+        begin = C_[c] + BWT_.rank(c, begin);
+        end = C_[c] + BWT_.rank(c, end);
+    }
+    return {begin, end};
+}
+
+std::vector<uint32_t> FMIndex::locate(const std::string & pattern) const {
+    auto range = findRange(pattern);
+    PackedArray samples(samples_.data(), sample_width_);
+
+    std::vector<uint32_t> result;
+    result.reserve(range.second - range.first);
+    for (size_t i = range.first; i < range.second; ++i) {
+        // Каждый шаг LF - на символ назад по тексту, поэтому кратная sample_rate позиция найдётся
+        // не больше чем за sample_rate - 1 шаг
+        size_t row = i;
+        size_t n_of_steps = 0;
+        size_t c;
+        while (!is_sampled_[row]) {
+            row = LF(row, c);
+            ++n_of_steps;
+        }
+        result.push_back(samples[is_sampled_.rank1(row)] + n_of_steps);
+    }
+    return result;
+}
+
+std::string FMIndex::extract(size_t start, size_t length) const {
+    size_t end = std::min(start + length, size_ - 1);
+    if (start >= end) {
+        return "";
+    }
+
+    // Ближайшая к концу отрезка сохранённая позиция; позиция '$' всегда на строке 0
+    size_t position = (end + sample_rate_ - 1) / sample_rate_ * sample_rate_;
+    size_t row = 0;
+    if (position < size_ - 1) {
+        row = PackedArray(inverse_samples_.data(), sample_width_)[position / sample_rate_];
+    }
+    else {
+        position = size_ - 1;
+    }
+
+    std::string result(end - start, '\0');
+    while (position > start) {
+        size_t c;
+        row = LF(row, c);
+        --position;
+        if (position < end) {
+            result[position - start] = symbols_[c];
+        }
+    }
+    return result;
+}
+
+// Суффиксный автомат (Blumer et al.), строится онлайн по одному символу: после каждого символа известно
+// число различных подстрок прочитанного текста. Новое состояние cur добавляет len(cur) - len(link(cur))
+// новых подстрок (суффиксы, которых раньше не было), клоны число подстрок не меняют. Амортизированно O(1) на символ.
+//
+// Состояния лежат подряд в одном массиве, не больше 2n. Переходы состояния - отсортированный массив
+// на SMALL_SIZE символов прямо в состоянии, при переполнении он переносится в плотную таблицу на 256 переходов
+// из общего пула. На тексте из небольшого алфавита почти все переходы остаются в состояниях.
+class SuffixAutomaton {
+private:
+    static constexpr size_t SMALL_SIZE = 4;
+    static constexpr size_t DENSE_SIZE = 256;
+    static constexpr uint32_t NONE = std::numeric_limits<uint32_t>::max();
+
+    struct State {
+        uint32_t len;   // длина самой длинной строки состояния
+        uint32_t link;  // суффиксная ссылка
+        uint32_t dense; // начало таблицы переходов в dense_, NONE - переходы в symbols и targets
+        uint8_t n_of_small;
+        uint8_t symbols[SMALL_SIZE];
+        uint32_t targets[SMALL_SIZE];
+    };
+
+    std::vector<State> states_;
+    std::vector<uint32_t> dense_;
+    uint32_t last_ = 0;
+    uint64_t n_of_different_substrings_ = 0;
+
+    uint32_t newState(uint32_t len, uint32_t link) {
+        State state{};
+        state.len = len;
+        state.link = link;
+        state.dense = NONE;
+        states_.push_back(state);
+        return states_.size() - 1;
+    }
+
+    uint32_t transition(uint32_t v, uint8_t c) const {
+        const State & state = states_[v];
+        if (state.dense != NONE) {
+            return dense_[state.dense + c];
+        }
+        for (size_t i = 0; i < state.n_of_small && state.symbols[i] <= c; ++i) {
+            if (state.symbols[i] == c) {
+                return state.targets[i];
+            }
+        }
+        return NONE;
+    }
+
+    void setTransition(uint32_t v, uint8_t c, uint32_t target) {
+        State & state = states_[v];
+        if (state.dense != NONE) {
+            dense_[state.dense + c] = target;
+            return;
+        }
+
+        size_t i = 0;
+        while (i < state.n_of_small && state.symbols[i] < c) {
+            ++i;
+        }
+        if (i < state.n_of_small && state.symbols[i] == c) {
+            state.targets[i] = target;
+            return;
+        }
+
+        if (state.n_of_small < SMALL_SIZE) {
+            // Вставка с сохранением порядка символов
+            for (size_t j = state.n_of_small; j > i; --j) {
+                state.symbols[j] = state.symbols[j - 1];
+                state.targets[j] = state.targets[j - 1];
+            }
+            state.symbols[i] = c;
+            state.targets[i] = target;
+            ++state.n_of_small;
+            return;
+        }
+
+        // Переносим переходы в плотную таблицу
+        uint32_t dense = dense_.size();
+        dense_.resize(dense_.size() + DENSE_SIZE, NONE);
+        for (size_t j = 0; j < state.n_of_small; ++j) {
+            dense_[dense + state.symbols[j]] = state.targets[j];
+        }
+        dense_[dense + c] = target;
+        state.dense = dense;
+        state.n_of_small = 0;
+    }
+
+    uint32_t cloneState(uint32_t q, uint32_t len) {
+        uint32_t clone = states_.size();
+        states_.push_back(states_[q]);
+        states_[clone].len = len;
+        if (states_[q].dense != NONE) {
+            uint32_t dense = dense_.size();
+            dense_.resize(dense_.size() + DENSE_SIZE);
+            std::copy_n(dense_.begin() + states_[q].dense, DENSE_SIZE, dense_.begin() + dense);
+            states_[clone].dense = dense;
+        }
+        return clone;
+    }
+
+public:
+    SuffixAutomaton() {
+        newState(0, NONE);
+    }
+
+    // Для текста длины n автомату нужно не больше 2n состояний
+    void reserve(size_t size) {
+        states_.reserve(2 * size + 1);
+    }
+
+    void push(char symbol) {
+        auto c = static_cast<uint8_t>(symbol);
+        uint32_t cur = newState(states_[last_].len + 1, 0);
+
+        uint32_t p = last_;
+        while (p != NONE && transition(p, c) == NONE) {
+            setTransition(p, c, cur);
+            p = states_[p].link;
+        }
+
+        if (p != NONE) {
+            uint32_t q = transition(p, c);
+            if (states_[p].len + 1 == states_[q].len) {
+                states_[cur].link = q;
+            }
+            else {
+                uint32_t clone = cloneState(q, states_[p].len + 1);
+                while (p != NONE && transition(p, c) == q) {
+                    setTransition(p, c, clone);
+                    p = states_[p].link;
+                }
+                states_[q].link = clone;
+                states_[cur].link = clone;
+            }
+        }
+
+        n_of_different_substrings_ += states_[cur].len - states_[states_[cur].link].len;
+        last_ = cur;
+    }
+
+    // Число различных непустых подстрок прочитанного текста
+    uint64_t calcDifferentSubstrings() const {
+        return n_of_different_substrings_;
+    }
+
+    size_t memoryUsage() const {
+        return states_.capacity() * sizeof(State) + dense_.capacity() * sizeof(uint32_t);
+    }
+};
+
+// Символы байтового текста для SuffixArray<>
+SuffixArray<>::Text toSymbols(const std::string & text) {
+    return SuffixArray<>::Text(text.begin(), text.end());
+}
+
+std::vector<std::string> readPatterns(const std::string & filename) {
+    // Шаблоны - по одному на строку
+    std::ifstream file(filename);
+    if (!file) {
+        perror(filename.c_str());
+        return { };
+    }
+
+    std::vector<std::string> patterns;
+    std::string pattern;
+    while (std::getline(file, pattern)) {
+        patterns.push_back(pattern);
+    }
+    return patterns;
+}
+
+int main(int argc, char ** argv) {
+    std::string patterns_filename;
+    std::string index_filename;
+    std::string build_filename;
+    size_t n_of_threads = 1;
+    size_t sa_sample_rate = 1;
+    size_t fm_sample_rate = 0;
+    size_t stream_period = 0;
+    size_t repeat_length = 0;
+
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (strcmp(argv[i], "-j") == 0) {
+            // строить суффиксный массив и LCP в N потоков
+            n_of_threads = std::max(1ul, strtoul(argv[i + 1], nullptr, 10));
+        }
+        else if (strcmp(argv[i], "-b") == 0) {
+            build_filename = argv[i + 1];
+        }
+        else if (strcmp(argv[i], "-s") == 0) {
+            sa_sample_rate = std::max(1ul, strtoul(argv[i + 1], nullptr, 10));
+        }
+        else if (strcmp(argv[i], "-i") == 0) {
+            index_filename = argv[i + 1];
+        }
+        else if (strcmp(argv[i], "-p") == 0) {
+            patterns_filename = argv[i + 1];
+        }
+        else if (strcmp(argv[i], "-z") == 0) {
+            fm_sample_rate = std::max(1ul, strtoul(argv[i + 1], nullptr, 10));
+        }
+        else if (strcmp(argv[i], "-a") == 0) {
+            stream_period = std::max(1ul, strtoul(argv[i + 1], nullptr, 10));
+        }
+        else if (strcmp(argv[i], "-r") == 0) {
+            repeat_length = std::max(1ul, strtoul(argv[i + 1], nullptr, 10));
+        }
+    }
+
+    if (stream_period > 0) {
+        // Поток символов: число различных подстрок после каждых stream_period символов и в конце,
+        // пробельные символы пропускаются
+        SuffixAutomaton automaton;
+        std::vector<char> buffer(1u << 16u);
+        std::string output;
+        size_t n_of_symbols = 0;
+        while (std::cin.read(buffer.data(), buffer.size()) || std::cin.gcount() > 0) {
+            for (auto it = buffer.begin(); it != buffer.begin() + std::cin.gcount(); ++it) {
+                if (isspace(static_cast<unsigned char>(*it))) {
+                    continue;
+                }
+                automaton.push(*it);
+                if (++n_of_symbols % stream_period == 0) {
+                    output += std::to_string(automaton.calcDifferentSubstrings());
+                    output += '\n';
+                }
+            }
+            std::cout << output;
+            output.clear();
+        }
+        if (n_of_symbols % stream_period != 0 || n_of_symbols == 0) {
+            std::cout << automaton.calcDifferentSubstrings() << '\n';
+        }
+        std::cerr << "Suffix automaton: " << automaton.memoryUsage() << " bytes" << std::endl;
+        return 0;
+    }
+
+    if (!index_filename.empty()) {
+        // Ответ по готовому индексу, текст не читается
+        SuffixArrayIndex index(index_filename);
+        if (!index.isOpen()) {
+            std::cerr << index_filename << ": not a suffix array index" << std::endl;
+            return 1;
+        }
+        std::cout << index.calcDifferentSubstrings();
+        return 0;
+    }
+
+    std::string text;
+    std::cin >> text;
+
+    SuffixArray<> suffix_array(toSymbols(text), n_of_threads > 1 ? SuffixArray<>::Builder::radixDoubling : SuffixArray<>::Builder::sais,
+                               n_of_threads);
+
+    if (!patterns_filename.empty()) {
+        // Число вхождений каждого шаблона, по одному на строку
+        auto patterns = readPatterns(patterns_filename);
+        std::vector<size_t> counts;
+        if (fm_sample_rate > 0) {
+            FMIndex fm_index(suffix_array, fm_sample_rate);
+            fm_index.printInfo(std::cerr);
+            for (auto & pattern : patterns) {
+                counts.push_back(fm_index.count(pattern));
+            }
+        }
+        else {
+            std::vector<SuffixArray<>::Text> symbol_patterns;
+            for (auto & pattern : patterns) {
+                symbol_patterns.push_back(toSymbols(pattern));
+            }
+            counts = suffix_array.count(symbol_patterns);
+        }
+
+        std::string output;
+        for (size_t count : counts) {
+            output += std::to_string(count);
+            output += '\n';
+        }
+        std::cout << output;
+        return 0;
+    }
+
+    if (repeat_length > 0) {
+        // Супермаксимальные повторы длины >= repeat_length: "позиция длина число_вхождений" на строку,
+        // в stderr - размер разбиения LZ77 как оценка сжимаемости
+        auto factors = suffix_array.factorizeLZ77();
+        size_t factor_bits = 2 * bitWidth(text.size());
+        std::cerr << "LZ77: " << factors.size() << " factors, ~" << (factors.size() * factor_bits + 7) / 8
+                  << " bytes (" << factor_bits << " bits per factor) of " << text.size() << std::endl;
+        std::cerr << "Maximal repeats: " << suffix_array.findMaximalRepeats(repeat_length).size() << std::endl;
+
+        std::string output;
+        for (auto & repeat : suffix_array.findSupermaximalRepeats(repeat_length)) {
+            output += std::to_string(repeat.position) + ' ' + std::to_string(repeat.length) + ' '
+                      + std::to_string(repeat.n_of_occurrences) + '\n';
+        }
+        std::cout << output;
+        return 0;
+    }
+
+    if (!build_filename.empty()) {
+        if (!suffix_array.save(build_filename, sa_sample_rate)) {
+            return 1;
+        }
+        SuffixArrayIndex(build_filename).printInfo(std::cerr);
+        return 0;
+    }
 
-    SuffixArray suffix_array(text);
     std::cout << suffix_array.calcDifferentSubstrings();
 
     return 0;
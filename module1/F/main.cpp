@@ -1,73 +1,590 @@
 #include <iostream>
+#include <fstream>
 #include <string>
 #include <utility>
 #include <vector>
+#include <deque>
 #include <optional>
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <thread>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Массив чисел по width бит, записанных подряд в 64-битные слова (младшие биты - раньше).
+// В конце всегда есть лишнее слово, чтобы число на стыке слов читалось без проверки границы.
+class PackedArray {
+private:
+    const uint64_t * words_ = nullptr;
+    int width_ = 0;
+    uint64_t mask_ = 0;
+
+public:
+    PackedArray() = default;
+    PackedArray(const uint64_t * words, int width) : words_(words), width_(width), mask_(width == 64 ? ~0ull : (1ull << width) - 1) {}
+
+    uint64_t operator[](size_t i) const {
+        size_t bit = i * width_;
+        size_t word = bit >> 6u;
+        size_t offset = bit & 63u;
+
+        uint64_t value = words_[word] >> offset;
+        if (offset + width_ > 64) {
+            value |= words_[word + 1] << (64 - offset);
+        }
+        return value & mask_;
+    }
+
+    static size_t wordsFor(size_t size, int width) {
+        return (size * width + 63) / 64 + 1;
+    }
+
+    // Упаковывает values[0], values[step], values[2 * step], ... по width бит
+    static std::vector<uint64_t> pack(const std::vector<int> & values, size_t step, int width) {
+        size_t size = (values.size() + step - 1) / step;
+        std::vector<uint64_t> words(wordsFor(size, width), 0);
+
+        for (size_t i = 0; i < size; ++i) {
+            uint64_t value = values[i * step];
+            size_t bit = i * width;
+            size_t word = bit >> 6u;
+            size_t offset = bit & 63u;
+
+            words[word] |= value << offset;
+            if (offset + width > 64) {
+                words[word + 1] |= value >> (64 - offset);
+            }
+        }
+        return words;
+    }
+};
+
+// Минимум на отрезке за O(1) при O(n) памяти. Массив делится на блоки по 64 элемента.
+// Внутри блока для каждой позиции r хранится маска позиций j <= r, на которых достигаются минимумы
+// values[j ... r] (стек минимумов при проходе блока слева направо), и минимум на [l, r] внутри блока -
+// младший бит маски r не левее l. Минимумы отрезков из целых блоков берутся из sparse table
+// над минимумами блоков (n / 64 log n чисел). Сам массив values не хранится: он передаётся в query,
+// так что RangeMin не ссылается на чужую память при копировании владельца массива.
+class RangeMin {
+private:
+    static const size_t BLOCK_SIZE = 64;
+    std::vector<uint64_t> masks_;
+    // sparse_table_[k][b] - минимум блоков b ... b + 2^k - 1
+    std::vector<std::vector<int>> sparse_table_;
+
+    int minInBlock(const int * values, size_t left, size_t right) const {
+        uint64_t mask = masks_[right] & (~0ull << (left % BLOCK_SIZE));
+        return values[right / BLOCK_SIZE * BLOCK_SIZE + __builtin_ctzll(mask)];
+    }
+
+public:
+    RangeMin() = default;
+    RangeMin(const int * values, size_t size) : masks_(size) {
+        size_t n_of_blocks = (size + BLOCK_SIZE - 1) / BLOCK_SIZE;
+        sparse_table_.emplace_back(n_of_blocks);
+
+        for (size_t block = 0; block < n_of_blocks; ++block) {
+            size_t begin = block * BLOCK_SIZE;
+            size_t end = std::min(size, begin + BLOCK_SIZE);
+            uint64_t mask = 0;
+            for (size_t i = begin; i < end; ++i) {
+                // Снимаем со стека позиции, значения на которых не меньше values[i]
+                while (mask != 0 && values[begin + 63 - __builtin_clzll(mask)] >= values[i]) {
+                    mask &= ~(1ull << (63 - __builtin_clzll(mask)));
+                }
+                mask |= 1ull << (i - begin);
+                masks_[i] = mask;
+            }
+            // Дно стека на конце блока - минимум всего блока
+            sparse_table_[0][block] = values[begin + __builtin_ctzll(mask)];
+        }
+
+        for (size_t k = 1; (1ul << k) <= n_of_blocks; ++k) {
+            const auto & previous = sparse_table_[k - 1];
+            std::vector<int> level(n_of_blocks - (1ul << k) + 1);
+            for (size_t block = 0; block < level.size(); ++block) {
+                level[block] = std::min(previous[block], previous[block + (1ul << (k - 1))]);
+            }
+            sparse_table_.push_back(std::move(level));
+        }
+    }
+
+    // Минимум values[left ... right], left <= right; values - тот же массив, что и в конструкторе
+    int query(const int * values, size_t left, size_t right) const {
+        size_t left_block = left / BLOCK_SIZE;
+        size_t right_block = right / BLOCK_SIZE;
+        if (left_block == right_block) {
+            return minInBlock(values, left, right);
+        }
+
+        int result = std::min(minInBlock(values, left, left_block * BLOCK_SIZE + BLOCK_SIZE - 1),
+                                minInBlock(values, right_block * BLOCK_SIZE, right));
+        if (left_block + 1 < right_block) {
+            int k = 63 - __builtin_clzll(right_block - left_block - 1);
+            const auto & level = sparse_table_[k];
+            result = std::min({result, level[left_block + 1], level[right_block - (1ul << k)]});
+        }
+        return result;
+    }
+
+    size_t memoryUsage() const {
+        size_t result = masks_.size() * sizeof(uint64_t);
+        for (const auto & level : sparse_table_) {
+            result += level.size() * sizeof(int);
+        }
+        return result;
+    }
+};
 
 class SuffixArray {
 private:
     const size_t ALPHABET_SIZE = 256;
+    // Разделитель строк в text_, меньше всех символов строк. LCP на нём обрывается,
+    // поэтому общие префиксы суффиксов не переходят из одной строки в другую
+    const char STRING_SPLITTER = '$';
     size_t size_;
     std::string text_;
     std::vector<int> suffix_array_;
     std::vector<int> equivalence_classes_;
     std::vector<int> LCP_;
     size_t n_of_classes_ = 0;
+    size_t n_of_threads_;
+
+    // LCP-LR для бинпоиска: lcp середины отрезка бинпоиска с его левым и правым концом.
+    // Обе половины лежат рядом, чтобы шаг бинпоиска читал одну кэш-линию
+    struct LCPLR {
+        int left;
+        int right;
+    };
+    std::vector<LCPLR> LCP_LR_;
+
+    // Для LCE: позиция каждого суффикса в суффиксном массиве и минимум на отрезке LCP_
+    std::vector<int> rank_;
+    RangeMin LCP_range_min_;
+
+    // Для пакетных orderedCommonSubstrings: позиции суффиксного массива, на которых растёт число
+    // найденных общих подстрок двух строк, и это число после них (возрастает)
+    std::vector<int> common_substring_positions_;
+    std::vector<uint64_t> n_of_common_substrings_;
+    bool has_common_substring_counts_ = false;
 
     size_t n_of_strings_ = 1;
-    std::vector<size_t> length_of_strings_;
+    std::vector<size_t> length_of_strings_; // длины строк вместе с разделителем
+    std::vector<size_t> end_of_strings_;    // позиции разделителей строк в text_
+    // Номер строки, которой принадлежит suffix_array_[i], упакован в PackedArray по document_width_ бит
+    std::vector<uint64_t> document_words_;
+    int document_width_ = 0;
 
 public:
-    explicit SuffixArray(std::string text);
-    SuffixArray(const std::string & text1, const std::string & text2) : SuffixArray(text1 + '$' + text2) {
-        n_of_strings_ = 2;
-        length_of_strings_.push_back(text1.size() + 1);
-        length_of_strings_.push_back(text2.size() + 1);
-    }
+    // Алгоритм построения суффиксного массива
+    enum class Builder {
+        sais,           // SA-IS, O(n)
+        doubling,       // удвоение длины циклических подстрок, O(n log n)
+        radixDoubling   // удвоение с поразрядной сортировкой пар рангов и без уже отсортированных групп,
+                        // строится в n_of_threads потоков
+    };
+
+    // Обобщённый суффиксный массив строк texts: text_ = texts[0] + '$' + texts[1] + '$' + ... + texts[K - 1] + '#'
+    explicit SuffixArray(const std::vector<std::string> & texts, Builder builder = Builder::sais, size_t n_of_threads = 1);
+    explicit SuffixArray(std::string text, Builder builder = Builder::sais, size_t n_of_threads = 1)
+            : SuffixArray(std::vector<std::string>{std::move(text)}, builder, n_of_threads) {}
+    SuffixArray(const std::string & text1, const std::string & text2, Builder builder = Builder::sais, size_t n_of_threads = 1)
+            : SuffixArray(std::vector<std::string>{text1, text2}, builder, n_of_threads) {}
 
 private:
-    void fillSuffixArray();
+    void fillSuffixArray(Builder builder);
+    void fillSuffixArrayUsingDoubling();
+    void fillSuffixArrayUsingSAIS();
+    void fillSuffixArrayUsingRadixDoubling();
 
     void sortByFirst2PowKSymbols(size_t k);
     void buildLCPUsingKasai();
+    void buildLCPUsingPhi();
+    void buildDocuments();
+
+    void buildLCPLR();
+    int fillLCPLR(long left, long right);
+    // Состояние бинпоиска: отрезок (left, right) и lcp pattern с его концами
+    struct Bound {
+        long left;
+        long right;
+        size_t left_match;
+        size_t right_match;
+    };
+    long findBound(const std::string & pattern, Bound & bound, bool is_prefix_less, bool stop_at_pattern) const;
+    // [begin, end) - отрезок суффиксного массива из суффиксов, начинающихся с pattern
+    std::pair<size_t, size_t> findRange(const std::string & pattern) const;
+    // Вызывает on_range(i, findRange(patterns[i])) для всех шаблонов в n_of_threads потоков
+    template<class Callback>
+    void findRanges(const std::vector<std::string> & patterns, Callback on_range);
+
+    void buildCommonSubstringCounts();
 
 public:
     [[nodiscard]] std::optional<std::string> orderedCommonSubstring(size_t order_len) const;
+    // То же для многих order_len: суффиксный массив проходится один раз, дальше каждый ответ - бинпоиск
+    std::vector<std::optional<std::string>> orderedCommonSubstrings(const std::vector<size_t> & order_lens);
+
+    size_t nOfStrings() const {
+        return n_of_strings_;
+    }
+    // Номер строки, которой принадлежит суффикс suffix_array_[i]
+    size_t documentAt(size_t i) const {
+        return PackedArray(document_words_.data(), document_width_)[i];
+    }
+    // Самая длинная подстрока, которая есть хотя бы в min_n_of_strings строках, O(n)
+    [[nodiscard]] std::optional<std::string> longestCommonSubstring(size_t min_n_of_strings) const;
+    // Число различных подстрок каждой строки, O(n log n)
+    std::vector<uint64_t> calcDifferentSubstringsOfStrings() const;
+
+    // Записывает текст, суффиксный массив и LCP в файл индекса, который потом открывается SuffixArrayIndex
+    bool save(const std::string & filename) const;
+
+    // Число вхождений pattern в текст и позиции их начал (в порядке суффиксного массива), O(p + log n)
+    size_t count(const std::string & pattern);
+    std::vector<int> locate(const std::string & pattern);
+    // То же для многих шаблонов сразу, шаблоны делятся между n_of_threads потоками
+    std::vector<size_t> count(const std::vector<std::string> & patterns);
+    std::vector<std::vector<int>> locate(const std::vector<std::string> & patterns);
+
+    // Строит массив рангов и RMQ над LCP для longestCommonExtension
+    void buildLCE();
+    // Длина общего префикса суффиксов text_[i ...] и text_[j ...], O(1). Как и LCP, не продолжается
+    // за конец строки, в которой лежит суффикс
+    size_t longestCommonExtension(size_t i, size_t j) const;
 };
 
-SuffixArray::SuffixArray(std::string text) : text_(std::move(text)){
-    text_ += '#';
+SuffixArray::SuffixArray(const std::vector<std::string> & texts, Builder builder, size_t n_of_threads)
+        : n_of_threads_(std::max<size_t>(1, n_of_threads)), n_of_strings_(texts.size()) {
+    assert(!texts.empty() && "at least one string is needed");
+
+    size_t total_size = 0;
+    for (const auto & text : texts) {
+        total_size += text.size() + 1;
+    }
+    text_.reserve(total_size);
+    for (size_t i = 0; i < n_of_strings_; ++i) {
+        text_ += texts[i];
+        text_ += i + 1 < n_of_strings_ ? STRING_SPLITTER : '#';
+        length_of_strings_.push_back(texts[i].size() + 1);
+        end_of_strings_.push_back(text_.size() - 1);
+    }
     size_ = text_.size();
     suffix_array_.resize(size_);
-    equivalence_classes_.resize(size_);
 
-    fillSuffixArray();
-    buildLCPUsingKasai();
+    fillSuffixArray(builder);
+    buildLCPUsingPhi();
+    buildDocuments();
+}
+
+// SA-IS (Nong, Zhang, Chan): суффиксы делятся на S-типа (меньше следующего суффикса) и L-типа (больше),
+// сортируются только LMS-подстроки (S-суффикс, перед которым L-суффикс), по ним индуцированной сортировкой
+// восстанавливается порядок всех суффиксов. Если имена LMS-подстрок не уникальны, задача рекурсивно решается
+// для строки из имён, которая не длиннее n / 2. Время O(n).
+//
+// symbols[i] - символ из [0, alphabet_size), последний символ строки должен быть единственным нулём.
+// Память: сам suffix_array (он же рабочий буфер для рекурсии), n бит типов и корзины размера алфавита.
+namespace sais {
+
+template<class Symbols>
+void getBuckets(const Symbols & symbols, size_t n, std::vector<int> & bucket, bool end) {
+    // bucket[c] - начало (или конец) корзины символа c в суффиксном массиве
+    std::fill(bucket.begin(), bucket.end(), 0);
+    for (size_t i = 0; i < n; ++i) {
+        ++bucket[symbols[i]];
+    }
+    int sum = 0;
+    for (auto & size : bucket) {
+        sum += size;
+        size = end ? sum : sum - size;
+    }
+}
+
+inline bool isLMS(const std::vector<bool> & is_s_type, int i) {
+    return i > 0 && is_s_type[i] && !is_s_type[i - 1];
+}
+
+template<class Symbols>
+void induce(const Symbols & symbols, int * suffix_array, size_t n, const std::vector<bool> & is_s_type, std::vector<int> & bucket) {
+    // L-суффиксы: проходом слева направо ставим i - 1 в начало его корзины
+    getBuckets(symbols, n, bucket, false);
+    for (size_t i = 0; i < n; ++i) {
+        int j = suffix_array[i] - 1;
+        if (j >= 0 && !is_s_type[j]) {
+            suffix_array[bucket[symbols[j]]++] = j;
+        }
+    }
+    // S-суффиксы: проходом справа налево ставим i - 1 в конец его корзины
+    getBuckets(symbols, n, bucket, true);
+    for (size_t i = n; i > 0; --i) {
+        int j = suffix_array[i - 1] - 1;
+        if (j >= 0 && is_s_type[j]) {
+            suffix_array[--bucket[symbols[j]]] = j;
+        }
+    }
+}
+
+// Строка имён LMS-подстрок для рекурсии
+struct IntSymbols {
+    const int * data;
+    int operator[](size_t i) const {
+        return data[i];
+    }
+};
+
+template<class Symbols>
+void build(const Symbols & symbols, int * suffix_array, size_t n, size_t alphabet_size) {
+    if (n == 1) {
+        suffix_array[0] = 0;
+        return;
+    }
+
+    std::vector<bool> is_s_type(n);
+    is_s_type[n - 1] = true;
+    is_s_type[n - 2] = false;
+    for (size_t i = n - 2; i > 0; --i) {
+        is_s_type[i - 1] = symbols[i - 1] < symbols[i] || (symbols[i - 1] == symbols[i] && is_s_type[i]);
+    }
+
+    // 1. Сортируем LMS-подстроки: кладём LMS-суффиксы в концы корзин и индуцируем
+    std::vector<int> bucket(alphabet_size);
+    getBuckets(symbols, n, bucket, true);
+    std::fill(suffix_array, suffix_array + n, -1);
+    for (size_t i = 1; i < n; ++i) {
+        if (isLMS(is_s_type, i)) {
+            suffix_array[--bucket[symbols[i]]] = i;
+        }
+    }
+    induce(symbols, suffix_array, n, is_s_type, bucket);
+
+    // Сжимаем отсортированные LMS-подстроки в начало массива
+    size_t n1 = 0;
+    for (size_t i = 0; i < n; ++i) {
+        if (isLMS(is_s_type, suffix_array[i])) {
+            suffix_array[n1++] = suffix_array[i];
+        }
+    }
+
+    // Даём LMS-подстрокам имена: равные подстроки - равные имена. Имя подстроки, начинающейся в pos,
+    // пишем в suffix_array[n1 + pos / 2] (LMS-позиции отстоят друг от друга хотя бы на 2)
+    std::fill(suffix_array + n1, suffix_array + n, -1);
+    int name = 0;
+    int previous = -1;
+    for (size_t i = 0; i < n1; ++i) {
+        int pos = suffix_array[i];
+        bool is_different = false;
+        for (size_t d = 0; d < n; ++d) {
+            if (previous == -1 || symbols[pos + d] != symbols[previous + d] || is_s_type[pos + d] != is_s_type[previous + d]) {
+                is_different = true;
+                break;
+            }
+            if (d > 0 && (isLMS(is_s_type, pos + d) || isLMS(is_s_type, previous + d))) {
+                break;
+            }
+        }
+        if (is_different) {
+            ++name;
+            previous = pos;
+        }
+        suffix_array[n1 + pos / 2] = name - 1;
+    }
+    for (size_t i = n, j = n; i > n1; --i) {
+        if (suffix_array[i - 1] >= 0) {
+            suffix_array[--j] = suffix_array[i - 1];
+        }
+    }
+
+    // 2. Сортируем LMS-суффиксы: рекурсивно, если имена не уникальны, иначе порядок задают сами имена
+    int * suffix_array_1 = suffix_array;
+    int * symbols_1 = suffix_array + n - n1;
+    if (static_cast<size_t>(name) < n1) {
+        build(IntSymbols{symbols_1}, suffix_array_1, n1, name);
+    }
+    else {
+        for (size_t i = 0; i < n1; ++i) {
+            suffix_array_1[symbols_1[i]] = i;
+        }
+    }
+
+    // 3. Индуцируем порядок всех суффиксов по отсортированным LMS-суффиксам
+    getBuckets(symbols, n, bucket, true);
+    for (size_t i = 1, j = 0; i < n; ++i) {
+        if (isLMS(is_s_type, i)) {
+            symbols_1[j++] = i;
+        }
+    }
+    for (size_t i = 0; i < n1; ++i) {
+        suffix_array_1[i] = symbols_1[suffix_array_1[i]];
+    }
+    std::fill(suffix_array + n1, suffix_array + n, -1);
+    for (size_t i = n1; i > 0; --i) {
+        int j = suffix_array[i - 1];
+        suffix_array[i - 1] = -1;
+        suffix_array[--bucket[symbols[j]]] = j;
+    }
+    induce(symbols, suffix_array, n, is_s_type, bucket);
+}
+
+} // namespace sais
+
+// Символы text_ для SA-IS: последний символ - единственный и наименьший (0), остальные сдвинуты на 1
+struct TextSymbols {
+    const char * text;
+    size_t last;
+    int operator[](size_t i) const {
+        return i == last ? 0 : static_cast<unsigned char>(text[i]) + 1;
+    }
+};
+
+int bitWidth(uint64_t x) {
+    // количество бит, нужное для записи x
+    int width = 0;
+    for (; x > 0; x >>= 1u) {
+        ++width;
+    }
+    return width;
 }
 
-void SuffixArray::fillSuffixArray() {
-    // Сначала отсортируем подстроки по 0му символу (нумерация с нуля)
+// Начало куска part из n_of_parts примерно равных кусков отрезка [0, size)
+inline size_t chunkBegin(size_t size, size_t n_of_parts, size_t part) {
+    return size * part / n_of_parts;
+}
 
-    std::vector<int> counter(ALPHABET_SIZE, 0); //  счетчик вхождений сортировки подсчётом
-    for (auto ch : text_) {
-        ++counter[ch];
+// Выполняет task(t) для t = 0 ... n_of_threads - 1, task(0) - в текущем потоке
+template<class Task>
+void runInThreads(size_t n_of_threads, const Task & task) {
+    std::vector<std::thread> workers;
+    for (size_t t = 1; t < n_of_threads; ++t) {
+        workers.emplace_back([&task, t]() { task(t); });
+    }
+    task(0);
+    for (auto & worker : workers) {
+        worker.join();
     }
-    for (size_t i = 1; i < ALPHABET_SIZE; ++i) {
+}
+
+void radixSort(std::vector<uint64_t> & keys, std::vector<int> & values,
+               std::vector<uint64_t> & keys_1, std::vector<int> & values_1, size_t size, int key_bits,
+               size_t n_of_threads) {
+    // LSD поразрядная сортировка первых size пар (keys[i], values[i]) по ключу, в котором значимы только
+    // младшие key_bits бит. Разряды по 11 бит (гистограмма разряда помещается в L1), гистограммы всех
+    // разрядов считаются за один проход, разряды, одинаковые у всех ключей, пропускаются.
+    // Результат остаётся в keys и values.
+    //
+    // Массив делится на n_of_threads кусков, у каждого потока свои гистограммы, и элементы значения c
+    // из куска t пишутся после элементов значения c из кусков 0 ... t - 1, поэтому сортировка остаётся устойчивой.
+    // После перестановки куски состоят уже из других элементов, и следующий разряд приходится считать заново.
+    const int DIGIT_BITS = 11;
+    const size_t N_OF_DIGIT_VALUES = 1u << DIGIT_BITS;
+    const int n_of_digits = (key_bits + DIGIT_BITS - 1) / DIGIT_BITS;
+
+    auto digit = [](uint64_t key, int d) { return (key >> (d * DIGIT_BITS)) & (N_OF_DIGIT_VALUES - 1); };
+
+    // counter[(t * n_of_digits + d) * N_OF_DIGIT_VALUES + c] - число ключей куска t со значением c в разряде d
+    std::vector<size_t> counter(n_of_threads * n_of_digits * N_OF_DIGIT_VALUES, 0);
+    auto countDigits = [&](size_t t, int first_digit, int last_digit) {
+        size_t * thread_counter = counter.data() + t * n_of_digits * N_OF_DIGIT_VALUES;
+        std::fill(thread_counter + first_digit * N_OF_DIGIT_VALUES, thread_counter + last_digit * N_OF_DIGIT_VALUES, 0);
+
+        for (size_t i = chunkBegin(size, n_of_threads, t); i < chunkBegin(size, n_of_threads, t + 1); ++i) {
+            for (int d = first_digit; d < last_digit; ++d) {
+                ++thread_counter[d * N_OF_DIGIT_VALUES + digit(keys[i], d)];
+            }
+        }
+    };
+
+    runInThreads(n_of_threads, [&](size_t t) { countDigits(t, 0, n_of_digits); });
+
+    bool is_counter_actual = true;
+    for (int d = 0; d < n_of_digits; ++d) {
+        size_t n_of_equal_digits = 0;
+        for (size_t t = 0; t < n_of_threads; ++t) {
+            n_of_equal_digits += counter[(t * n_of_digits + d) * N_OF_DIGIT_VALUES + digit(keys[0], d)];
+        }
+        if (n_of_equal_digits == size) {
+            continue;
+        }
+
+        if (!is_counter_actual) {
+            runInThreads(n_of_threads, [&](size_t t) { countDigits(t, d, d + 1); });
+        }
+
+        size_t sum = 0;
+        for (size_t c = 0; c < N_OF_DIGIT_VALUES; ++c) {
+            for (size_t t = 0; t < n_of_threads; ++t) {
+                size_t & starts_with = counter[(t * n_of_digits + d) * N_OF_DIGIT_VALUES + c];
+                size_t n_of_keys = starts_with;
+                starts_with = sum;
+                sum += n_of_keys;
+            }
+        }
+
+        runInThreads(n_of_threads, [&](size_t t) {
+            size_t * starts_with = counter.data() + (t * n_of_digits + d) * N_OF_DIGIT_VALUES;
+            for (size_t i = chunkBegin(size, n_of_threads, t); i < chunkBegin(size, n_of_threads, t + 1); ++i) {
+                size_t j = starts_with[digit(keys[i], d)]++;
+                keys_1[j] = keys[i];
+                values_1[j] = values[i];
+            }
+        });
+        keys.swap(keys_1);
+        values.swap(values_1);
+
+        // Гистограммы одного потока остаются верными для всех разрядов
+        is_counter_actual = n_of_threads == 1;
+    }
+}
+
+void SuffixArray::fillSuffixArray(Builder builder) {
+    if (builder == Builder::sais) {
+        fillSuffixArrayUsingSAIS();
+    }
+    else if (builder == Builder::radixDoubling) {
+        fillSuffixArrayUsingRadixDoubling();
+    }
+    else {
+        fillSuffixArrayUsingDoubling();
+    }
+}
+
+void SuffixArray::fillSuffixArrayUsingSAIS() {
+    // '#' в конце text_ считаем меньше всех символов, поэтому порядок совпадает с циклической сортировкой
+    sais::build(TextSymbols{text_.data(), size_ - 1}, suffix_array_.data(), size_, ALPHABET_SIZE + 1);
+}
+
+void SuffixArray::fillSuffixArrayUsingDoubling() {
+    equivalence_classes_.resize(size_);
+
+    // Сначала отсортируем подстроки по 0му символу (нумерация с нуля). Символы берём как в SA-IS:
+    // байты без знака, сдвинутые на 1, '#' - наименьший символ 0
+
+    TextSymbols symbols{text_.data(), size_ - 1};
+    std::vector<int> counter(ALPHABET_SIZE + 1, 0); //  счетчик вхождений сортировки подсчётом
+    for (size_t i = 0; i < size_; ++i) {
+        ++counter[symbols[i]];
+    }
+    for (size_t i = 1; i < ALPHABET_SIZE + 1; ++i) {
         counter[i] += counter[i - 1];
     }
     for (size_t i = 0; i < size_; ++i) {
-        --counter[text_[i]];
+        --counter[symbols[i]];
 
         // сортируем подстроки по возрастанию 0го символа? точнее записываем,
         // какая строка будет стоять на i-ой позиции в suffix_array
-        suffix_array_[counter[text_[i]]] = i;
+        suffix_array_[counter[symbols[i]]] = i;
     }
 
     // Потом заполним массив классов эквивалентностей
 
     n_of_classes_ = 1;
     for (size_t i = 1; i < size_; ++i) {
-        if (text_[suffix_array_[i]] != text_[suffix_array_[i - 1]]) {
+        if (symbols[suffix_array_[i]] != symbols[suffix_array_[i - 1]]) {
             ++n_of_classes_;
         }
 
@@ -90,6 +607,164 @@ void SuffixArray::fillSuffixArray() {
         sortByFirst2PowKSymbols(k);
     }
 }
+void SuffixArray::fillSuffixArrayUsingRadixDoubling() {
+    // Удвоение (Larsson–Sadakane): суффиксы разбиты на группы с одинаковыми первыми k символами,
+    // ранг суффикса - позиция начала его группы в suffix_array_. На шаге k каждая группа из нескольких суффиксов
+    // сортируется по рангу суффикса i + k. Группы из одного суффикса уже стоят на своих местах
+    // и в следующих шагах не участвуют, поэтому на повторяющихся строках шаги быстро становятся дешёвыми.
+    //
+    // Пара (номер группы, ранг суффикса i + k) упаковывается в один 64-битный ключ, и все группы шага
+    // сортируются одной поразрядной сортировкой по непрерывному массиву: номера групп идут по возрастанию,
+    // поэтому после сортировки каждая группа остаётся на своём отрезке. Шаг k = 0 - сортировка
+    // единственной группы из всех суффиксов по первому символу.
+    //
+    // '#' в конце text_ считаем меньше всех символов (как в SA-IS). Тогда у суффиксов неотсортированной группы
+    // первые k символов не содержат '#', то есть i + k < size_, и "закольцовывать" подстроки не нужно.
+    //
+    // Каждый шаг (сбор ключей, сортировка, разбиение групп) делится между n_of_threads_ потоками
+    // по элементам, а не по группам, так что одна большая группа тоже сортируется параллельно.
+
+    const size_t MIN_KEYS_PER_THREAD = 1u << 16u;
+    const size_t NO_BORDER = std::numeric_limits<size_t>::max();
+
+    TextSymbols symbols{text_.data(), size_ - 1};
+    equivalence_classes_.resize(size_);
+    std::vector<int> & rank = equivalence_classes_;
+
+    for (size_t i = 0; i < size_; ++i) {
+        suffix_array_[i] = i;
+    }
+
+    // Отрезки [begin, end) suffix_array_ с группами, в которых больше одного суффикса
+    std::vector<std::pair<int, int>> groups = {{0, static_cast<int>(size_)}};
+    std::vector<std::vector<std::pair<int, int>>> next_groups(n_of_threads_);
+
+    // offsets[g] - позиция первого ключа группы g
+    std::vector<size_t> offsets;
+    std::vector<size_t> offsets_of_chunks(n_of_threads_ + 1);
+    std::vector<size_t> last_borders(n_of_threads_);
+
+    std::vector<uint64_t> keys(size_);
+    std::vector<uint64_t> keys_1(size_);
+    std::vector<int> suffixes(size_);
+    std::vector<int> suffixes_1(size_);
+    const int rank_bits = std::max(bitWidth(size_), bitWidth(ALPHABET_SIZE));
+
+    for (size_t k = 0; !groups.empty(); k = (k == 0 ? 1 : k << 1u)) {
+        size_t n_of_groups = groups.size();
+
+        // Позиции групп среди ключей - префиксные суммы размеров групп, сначала по кускам, потом внутри кусков
+        size_t n_of_threads = std::min(n_of_threads_, std::max<size_t>(1, n_of_groups / MIN_KEYS_PER_THREAD));
+        offsets.resize(n_of_groups + 1);
+        runInThreads(n_of_threads, [&](size_t t) {
+            size_t sum = 0;
+            for (size_t g = chunkBegin(n_of_groups, n_of_threads, t); g < chunkBegin(n_of_groups, n_of_threads, t + 1); ++g) {
+                sum += groups[g].second - groups[g].first;
+            }
+            offsets_of_chunks[t + 1] = sum;
+        });
+        offsets_of_chunks[0] = 0;
+        for (size_t t = 0; t < n_of_threads; ++t) {
+            offsets_of_chunks[t + 1] += offsets_of_chunks[t];
+        }
+        runInThreads(n_of_threads, [&](size_t t) {
+            size_t sum = offsets_of_chunks[t];
+            for (size_t g = chunkBegin(n_of_groups, n_of_threads, t); g < chunkBegin(n_of_groups, n_of_threads, t + 1); ++g) {
+                offsets[g] = sum;
+                sum += groups[g].second - groups[g].first;
+            }
+        });
+        const size_t n_of_keys = offsets_of_chunks[n_of_threads];
+        offsets[n_of_groups] = n_of_keys;
+
+        n_of_threads = std::min(n_of_threads_, std::max<size_t>(1, n_of_keys / MIN_KEYS_PER_THREAD));
+
+        // Сбор ключей: поток берёт свой кусок ключей, первую группу куска находит бинпоиском по offsets
+        runInThreads(n_of_threads, [&](size_t t) {
+            size_t p = chunkBegin(n_of_keys, n_of_threads, t);
+            size_t end = chunkBegin(n_of_keys, n_of_threads, t + 1);
+            size_t g = std::upper_bound(offsets.begin(), offsets.end(), p) - offsets.begin() - 1;
+
+            for (; p < end; ++p) {
+                while (offsets[g + 1] <= p) {
+                    ++g;
+                }
+                int i = suffix_array_[groups[g].first + (p - offsets[g])];
+                uint64_t second = k == 0 ? symbols[i] : rank[i + k];
+                keys[p] = (static_cast<uint64_t>(g) << rank_bits) | second;
+                suffixes[p] = i;
+            }
+        });
+
+        radixSort(keys, suffixes, keys_1, suffixes_1, n_of_keys, bitWidth(n_of_groups - 1) + rank_bits, n_of_threads);
+
+        // Разбиение групп. Новая группа начинается там, где ключ отличается от предыдущего,
+        // её ранг - позиция её начала. Граница группы может попасть в кусок другого потока,
+        // поэтому сначала каждый поток находит последнюю границу в своём куске.
+        auto isBorder = [&](size_t p) { return p == 0 || p == n_of_keys || keys[p] != keys[p - 1]; };
+        auto positionOf = [&](size_t p) {
+            size_t g = keys[p] >> rank_bits;
+            return groups[g].first + (p - offsets[g]);
+        };
+
+        runInThreads(n_of_threads, [&](size_t t) {
+            last_borders[t] = NO_BORDER;
+            for (size_t p = chunkBegin(n_of_keys, n_of_threads, t + 1); p > chunkBegin(n_of_keys, n_of_threads, t); --p) {
+                if (isBorder(p - 1)) {
+                    last_borders[t] = p - 1;
+                    break;
+                }
+            }
+        });
+
+        // Ранги предыдущего шага уже упакованы в ключи, поэтому новые можно записывать сразу
+        runInThreads(n_of_threads, [&](size_t t) {
+            size_t begin = chunkBegin(n_of_keys, n_of_threads, t);
+            size_t end = chunkBegin(n_of_keys, n_of_threads, t + 1);
+            auto & thread_groups = next_groups[t];
+            thread_groups.clear();
+
+            // Начало группы, в которой лежит ключ begin (в куске 0 граница всегда есть)
+            size_t group_begin = 0;
+            for (size_t s = t; s > 0; --s) {
+                if (last_borders[s - 1] != NO_BORDER) {
+                    group_begin = last_borders[s - 1];
+                    break;
+                }
+            }
+            int group_position = positionOf(group_begin);
+
+            auto closeGroup = [&](size_t group_end) {
+                if (group_end - group_begin > 1) {
+                    thread_groups.emplace_back(group_position, group_position + (group_end - group_begin));
+                }
+            };
+
+            for (size_t p = begin; p < end; ++p) {
+                if (isBorder(p)) {
+                    if (p > begin) {
+                        closeGroup(p);
+                    }
+                    group_begin = p;
+                    group_position = positionOf(p);
+                }
+                suffix_array_[group_position + (p - group_begin)] = suffixes[p];
+                rank[suffixes[p]] = group_position;
+            }
+            if (begin < end && isBorder(end)) {
+                closeGroup(end);
+            }
+        });
+
+        groups.clear();
+        for (size_t t = 0; t < n_of_threads; ++t) {
+            groups.insert(groups.end(), next_groups[t].begin(), next_groups[t].end());
+        }
+    }
+
+    n_of_classes_ = size_;
+}
+
 void SuffixArray::sortByFirst2PowKSymbols(size_t k) {
     // На этом шаге сортировки выходным результатом будут отсортированные строки длины 2^k символов
 
@@ -170,9 +845,12 @@ void SuffixArray::buildLCPUsingKasai() {
             // То сравним текущую строку со следующей по порядку в суффиксном массиве
             size_t j = suffix_array_[position[i] + 1];
 
-            // И найдём в них количество повторяющихся символов
-            while (std::max(i + n_of_similar_symbols, j + n_of_similar_symbols) < size_
-                   && text_[i + n_of_similar_symbols] == text_[j + n_of_similar_symbols]) {
+            // И найдём в них количество повторяющихся символов. Последний символ ('#') единственный в своём роде
+            // и ни с чем не совпадает, даже если такой же байт встречается в тексте. На разделителе строк тоже
+            // останавливаемся: общая подстрока не может его содержать
+            while (std::max(i + n_of_similar_symbols, j + n_of_similar_symbols) < size_ - 1
+                   && text_[i + n_of_similar_symbols] == text_[j + n_of_similar_symbols]
+                   && text_[i + n_of_similar_symbols] != STRING_SPLITTER) {
                 ++n_of_similar_symbols;
             }
 
@@ -182,12 +860,282 @@ void SuffixArray::buildLCPUsingKasai() {
 
 }
 
-std::optional<std::string> SuffixArray::orderedCommonSubstring(size_t order_len) const {
-    if (n_of_strings_ != 2) {
-        return { };
+void SuffixArray::buildLCPUsingPhi() {
+    // LCP через Φ-массив (Kärkkäinen, Manzini, Puglisi): Φ[suffix_array_[p]] = suffix_array_[p + 1],
+    // PLCP[i] = lcp(i, Φ[i]) считается в порядке позиций текста, и как у Касаи PLCP[i + 1] >= PLCP[i] - 1.
+    // Позиции текста делятся на куски по потокам, в начале куска счётчик совпадающих символов начинается с нуля,
+    // то есть каждый поток переделывает не больше одного сравнения. PLCP пишется на место Φ,
+    // потом LCP_[p] = PLCP[suffix_array_[p]]. Даже в один поток это быстрее Касаи: text_ читается подряд.
+    const int NONE = -1;
+    std::vector<int> phi(size_);
+
+    runInThreads(n_of_threads_, [this, &phi](size_t t) {
+        for (size_t p = chunkBegin(size_, n_of_threads_, t); p < chunkBegin(size_, n_of_threads_, t + 1); ++p) {
+            phi[suffix_array_[p]] = p + 1 < size_ ? suffix_array_[p + 1] : NONE;
+        }
+    });
+
+    runInThreads(n_of_threads_, [this, &phi](size_t t) {
+        size_t n_of_similar_symbols = 0;
+        for (size_t i = chunkBegin(size_, n_of_threads_, t); i < chunkBegin(size_, n_of_threads_, t + 1); ++i) {
+            if (phi[i] == NONE) {
+                n_of_similar_symbols = 0;
+                phi[i] = 0;
+                continue;
+            }
+
+            // Сравнение обрывается на '#' и на разделителе строк. Обрезанный так PLCP тоже убывает
+            // не больше чем на 1 за шаг (расстояние до разделителя уменьшается ровно на 1)
+            size_t j = phi[i];
+            while (std::max(i + n_of_similar_symbols, j + n_of_similar_symbols) < size_ - 1
+                   && text_[i + n_of_similar_symbols] == text_[j + n_of_similar_symbols]
+                   && text_[i + n_of_similar_symbols] != STRING_SPLITTER) {
+                ++n_of_similar_symbols;
+            }
+            phi[i] = n_of_similar_symbols;
+
+            if (n_of_similar_symbols > 0) {
+                --n_of_similar_symbols;
+            }
+        }
+    });
+
+    LCP_.resize(size_ - 1);
+    runInThreads(n_of_threads_, [this, &phi](size_t t) {
+        for (size_t p = chunkBegin(size_ - 1, n_of_threads_, t); p < chunkBegin(size_ - 1, n_of_threads_, t + 1); ++p) {
+            LCP_[p] = phi[suffix_array_[p]];
+        }
+    });
+}
+
+void SuffixArray::buildDocuments() {
+    // Сначала номер строки для каждой позиции текста (разделитель относится к строке перед ним),
+    // потом - в порядке суффиксного массива
+    std::vector<int> document_of_position(size_);
+    size_t begin = 0;
+    for (size_t i = 0; i < n_of_strings_; ++i) {
+        std::fill_n(document_of_position.begin() + begin, length_of_strings_[i], i);
+        begin += length_of_strings_[i];
+    }
+
+    std::vector<int> documents(size_);
+    for (size_t p = 0; p < size_; ++p) {
+        documents[p] = document_of_position[suffix_array_[p]];
+    }
+
+    document_width_ = bitWidth(n_of_strings_ - 1);
+    document_words_ = PackedArray::pack(documents, 1, document_width_);
+}
+
+void SuffixArray::buildLCE() {
+    rank_.resize(size_);
+    runInThreads(n_of_threads_, [this](size_t t) {
+        for (size_t p = chunkBegin(size_, n_of_threads_, t); p < chunkBegin(size_, n_of_threads_, t + 1); ++p) {
+            rank_[suffix_array_[p]] = p;
+        }
+    });
+    LCP_range_min_ = RangeMin(LCP_.data(), LCP_.size());
+}
+
+size_t SuffixArray::longestCommonExtension(size_t i, size_t j) const {
+    // lcp суффиксов - минимум LCP_ между их позициями в суффиксном массиве
+    assert(rank_.size() == size_ && "buildLCE() must be called first");
+    if (i == j) {
+        // до разделителя строк или '#'
+        return end_of_strings_[documentAt(rank_[i])] - i;
+    }
+    size_t left = rank_[i];
+    size_t right = rank_[j];
+    if (left > right) {
+        std::swap(left, right);
+    }
+    return LCP_range_min_.query(LCP_.data(), left, right - 1);
+}
+
+int SuffixArray::fillLCPLR(long left, long right) {
+    // Бинпоиск по суффиксному массиву всегда идёт по одному и тому же дереву отрезков (left, right),
+    // начиная с (-1, size_), где -1 и size_ - воображаемые суффиксы меньше и больше всех.
+    // Для середины middle каждого отрезка запоминаем lcp(left, middle) и lcp(middle, right),
+    // функция возвращает lcp(left, right) = min(LCP_[left ... right - 1]) (0 для воображаемых суффиксов).
+    bool is_real = left >= 0 && right < static_cast<long>(size_);
+
+    if (right - left == 1) {
+        return is_real ? LCP_[left] : 0;
+    }
+
+    long middle = left + (right - left) / 2;
+    LCP_LR_[middle].left = fillLCPLR(left, middle);
+    LCP_LR_[middle].right = fillLCPLR(middle, right);
+
+    return is_real ? std::min(LCP_LR_[middle].left, LCP_LR_[middle].right) : 0;
+}
+
+void SuffixArray::buildLCPLR() {
+    LCP_LR_.resize(size_);
+    fillLCPLR(-1, size_);
+}
+
+long SuffixArray::findBound(const std::string & pattern, Bound & bound, bool is_prefix_less, bool stop_at_pattern) const {
+    // Бинпоиск Манбера–Майерса: в bound.right - первый суффикс, который больше pattern. Суффикс, начинающийся с pattern,
+    // считается больше, если is_prefix_less == false (нижняя граница), и меньше - иначе (верхняя граница).
+    //
+    // Храним left_match = lcp(pattern, left) и right_match = lcp(pattern, right). Если, например,
+    // left_match >= right_match и lcp(left, middle) != left_match, то middle сравнивается с pattern
+    // без чтения текста, а иначе сравнение начинается сразу с символа left_match.
+    // Так каждый символ pattern совпадает не больше одного раза, и поиск работает за O(p + log n).
+    //
+    // Если stop_at_pattern, поиск останавливается на первой середине, которая начинается с pattern,
+    // и возвращает её (-1, если такой не встретилось): до неё поиски обеих границ идут одинаково.
+    TextSymbols symbols{text_.data(), size_ - 1};
+    const size_t pattern_size = pattern.size();
+
+    long & left = bound.left;
+    long & right = bound.right;
+    size_t & left_match = bound.left_match;
+    size_t & right_match = bound.right_match;
+
+    while (right - left > 1) {
+        long middle = left + (right - left) / 2;
+        size_t match = std::max(left_match, right_match);
+
+        if (left_match >= right_match) {
+            // middle и left совпадают дальше, чем pattern и left, значит middle с той же стороны от pattern, что и left
+            if (static_cast<size_t>(LCP_LR_[middle].left) > left_match) {
+                left = middle;
+                continue;
+            }
+            // middle отличается от left раньше, чем pattern, значит middle больше pattern
+            if (static_cast<size_t>(LCP_LR_[middle].left) < left_match) {
+                right = middle;
+                right_match = LCP_LR_[middle].left;
+                continue;
+            }
+        }
+        else {
+            if (static_cast<size_t>(LCP_LR_[middle].right) > right_match) {
+                right = middle;
+                continue;
+            }
+            if (static_cast<size_t>(LCP_LR_[middle].right) < right_match) {
+                left = middle;
+                left_match = LCP_LR_[middle].right;
+                continue;
+            }
+        }
+
+        // Сравниваем символы с match; '#' (символ 0) не совпадает ни с одним символом pattern
+        size_t suffix = suffix_array_[middle];
+        while (match < pattern_size && symbols[suffix + match] == static_cast<unsigned char>(pattern[match]) + 1) {
+            ++match;
+        }
+
+        if (match == pattern_size && stop_at_pattern) {
+            return middle;
+        }
+
+        bool is_middle_less = match == pattern_size ? is_prefix_less
+                                                    : symbols[suffix + match] < static_cast<unsigned char>(pattern[match]) + 1;
+        if (is_middle_less) {
+            left = middle;
+            left_match = match;
+        }
+        else {
+            right = middle;
+            right_match = match;
+        }
+    }
+
+    return -1;
+}
+
+std::pair<size_t, size_t> SuffixArray::findRange(const std::string & pattern) const {
+    Bound lower{-1, static_cast<long>(size_), 0, 0};
+    long middle = findBound(pattern, lower, false, true);
+    if (middle < 0) {
+        // pattern не встречается
+        return {lower.right, lower.right};
+    }
+
+    // Суффикс middle начинается с pattern: нижняя граница слева от него, верхняя - справа
+    Bound upper = lower;
+    lower.right = middle;
+    lower.right_match = pattern.size();
+    upper.left = middle;
+    upper.left_match = pattern.size();
+
+    findBound(pattern, lower, false, false);
+    findBound(pattern, upper, true, false);
+    return {lower.right, upper.right};
+}
+
+size_t SuffixArray::count(const std::string & pattern) {
+    if (LCP_LR_.empty()) {
+        buildLCPLR();
+    }
+
+    auto range = findRange(pattern);
+    return range.second - range.first;
+}
+
+std::vector<int> SuffixArray::locate(const std::string & pattern) {
+    if (LCP_LR_.empty()) {
+        buildLCPLR();
+    }
+
+    auto range = findRange(pattern);
+    return std::vector<int>(suffix_array_.begin() + range.first, suffix_array_.begin() + range.second);
+}
+
+template<class Callback>
+void SuffixArray::findRanges(const std::vector<std::string> & patterns, Callback on_range) {
+    // Шаблоны обрабатываются в порядке первых 8 символов: соседние бинпоиски проходят почти по одним
+    // и тем же элементам суффиксного массива, и они остаются в кэше. Сортировать шаблоны целиком
+    // дороже, а верх дерева бинпоиска и так определяется первыми символами.
+    // Отсортированный список делится на куски по потокам.
+    if (LCP_LR_.empty()) {
+        buildLCPLR();
+    }
+
+    std::vector<std::pair<uint64_t, size_t>> order(patterns.size());
+    for (size_t i = 0; i < order.size(); ++i) {
+        uint64_t prefix = 0;
+        for (size_t k = 0; k < 8; ++k) {
+            prefix = (prefix << 8u) | (k < patterns[i].size() ? static_cast<unsigned char>(patterns[i][k]) : 0);
+        }
+        order[i] = {prefix, i};
     }
+    std::sort(order.begin(), order.end());
+
+    size_t n_of_threads = std::min(n_of_threads_, std::max<size_t>(1, patterns.size()));
+    runInThreads(n_of_threads, [&](size_t t) {
+        for (size_t k = chunkBegin(order.size(), n_of_threads, t); k < chunkBegin(order.size(), n_of_threads, t + 1); ++k) {
+            size_t i = order[k].second;
+            on_range(i, findRange(patterns[i]));
+        }
+    });
+}
 
-    size_t index_of_string_splitter = length_of_strings_[0] - 1; // место, с которого начинается вторая строка
+std::vector<size_t> SuffixArray::count(const std::vector<std::string> & patterns) {
+    std::vector<size_t> result(patterns.size());
+    findRanges(patterns, [&result](size_t i, std::pair<size_t, size_t> range) {
+        result[i] = range.second - range.first;
+    });
+    return result;
+}
+
+std::vector<std::vector<int>> SuffixArray::locate(const std::vector<std::string> & patterns) {
+    std::vector<std::vector<int>> result(patterns.size());
+    findRanges(patterns, [this, &result](size_t i, std::pair<size_t, size_t> range) {
+        result[i].assign(suffix_array_.begin() + range.first, suffix_array_.begin() + range.second);
+    });
+    return result;
+}
+
+// order_len-я в лексикографическом порядке общая подстрока строк text = text1 + '$' + text2 + '#' длины size
+// по суффиксному массиву и LCP, index_of_string_splitter - позиция '$'
+template<class SuffixArrayT, class LCPArray>
+std::optional<std::string> findOrderedCommonSubstring(const char * text, const SuffixArrayT & suffix_array, const LCPArray & LCP,
+                                                      size_t size, size_t index_of_string_splitter, size_t order_len) {
     size_t n_of_matched_substring = 0; // число совпадающих подстрок
 
     // Мы пропускаем первые две строки (начинаются со служебных символов '$' и '#'), т.к. их рассмотрение ничего не даёт
@@ -195,17 +1143,17 @@ std::optional<std::string> SuffixArray::orderedCommonSubstring(size_t order_len)
     // Изначально min_LCP = 0, т.к. для корректности алгоритма min_LCP равен нулю на первых, "служебных", строках.
     size_t min_LCP = 0;
 
-    for (size_t i = 2; i < size_ - 1; ++i) {
+    for (size_t i = 2; i < size - 1; ++i) {
 
-        if (LCP_[i] < min_LCP) {
-            min_LCP = LCP_[i];
+        if (LCP[i] < min_LCP) {
+            min_LCP = LCP[i];
         }
 
         // если i-я и i+1-я подстроки в суффиксном массиве принадлежат разным строкам text1 и text2,
-        // то есть лежат по разные стороны от index_of_string_splitter в строке text_
-        if (suffix_array_[i] > index_of_string_splitter ^ suffix_array_[i + 1] > index_of_string_splitter) {
+        // то есть лежат по разные стороны от index_of_string_splitter в строке text
+        if (suffix_array[i] > index_of_string_splitter ^ suffix_array[i + 1] > index_of_string_splitter) {
             // Тут понятно
-            n_of_matched_substring += LCP_[i];
+            n_of_matched_substring += LCP[i];
 
             // Нам нужно вычесть уже учтенные подстроки. Их число будет равно LCP двух последних подстрок,
             // на которых мы заходили в этот if, то есть подстрок из одной строки,
@@ -214,7 +1162,7 @@ std::optional<std::string> SuffixArray::orderedCommonSubstring(size_t order_len)
             n_of_matched_substring -= min_LCP;
 
             // Насильно обновляем минимум
-            min_LCP = LCP_[i];
+            min_LCP = LCP[i];
         }
 
         // Заметим, что находить общие подстроки мы будем в лексикогрфическом порядке, т.к. мы ищем их в
@@ -223,25 +1171,436 @@ std::optional<std::string> SuffixArray::orderedCommonSubstring(size_t order_len)
         // Если это order_len-я по счету общая подстрока, выходим
         if (n_of_matched_substring >= order_len) {
             // Может оказаться так, что на очередном шаге мы нашли больше, чем нужно общих строк (n_of_matched_substring > order_len)
-            // Тогда выведем строку text_[j ... j + LCP_[i] - перескок], 
+            // Тогда выведем строку text[j ... j + LCP[i] - перескок], 
             // где перескок - то, насколько больше общих строк мы нашли на i-м шаге. Перескок = n_of_matched_substring - order_len
-            // А LCP_[i] - количество общих символов текущей и следующей строки (оно может буть больше, чем нам нужно!)
-            return {std::string(text_.begin() + suffix_array_[i],
-                    text_.begin() + suffix_array_[i] + LCP_[i] - (n_of_matched_substring - order_len))};
+            // А LCP[i] - количество общих символов текущей и следующей строки (оно может буть больше, чем нам нужно!)
+            return {std::string(text + suffix_array[i],
+                    text + suffix_array[i] + LCP[i] - (n_of_matched_substring - order_len))};
         }
     }
 
     return { };
 }
 
+std::optional<std::string> SuffixArray::orderedCommonSubstring(size_t order_len) const {
+    if (n_of_strings_ != 2) {
+        return { };
+    }
+
+    // место, с которого начинается вторая строка
+    return findOrderedCommonSubstring(text_.data(), suffix_array_, LCP_, size_, length_of_strings_[0] - 1, order_len);
+}
+
+void SuffixArray::buildCommonSubstringCounts() {
+    // Тот же проход, что в findOrderedCommonSubstring, но без остановки: запоминаем позиции, на которых
+    // n_of_matched_substring увеличивается. order_len-я подстрока - префикс суффикса на первой позиции,
+    // где счётчик дошёл до order_len
+    size_t index_of_string_splitter = length_of_strings_[0] - 1;
+    uint64_t n_of_matched_substring = 0;
+    size_t min_LCP = 0;
+
+    for (size_t i = 2; i < size_ - 1; ++i) {
+        if (static_cast<size_t>(LCP_[i]) < min_LCP) {
+            min_LCP = LCP_[i];
+        }
+
+        if ((static_cast<size_t>(suffix_array_[i]) > index_of_string_splitter) != (static_cast<size_t>(suffix_array_[i + 1]) > index_of_string_splitter)) {
+            if (LCP_[i] > static_cast<int>(min_LCP)) {
+                n_of_matched_substring += LCP_[i] - min_LCP;
+                common_substring_positions_.push_back(i);
+                n_of_common_substrings_.push_back(n_of_matched_substring);
+            }
+            min_LCP = LCP_[i];
+        }
+    }
+    has_common_substring_counts_ = true;
+}
+
+std::vector<std::optional<std::string>> SuffixArray::orderedCommonSubstrings(const std::vector<size_t> & order_lens) {
+    std::vector<std::optional<std::string>> result(order_lens.size());
+    if (n_of_strings_ != 2) {
+        return result;
+    }
+    if (!has_common_substring_counts_) {
+        buildCommonSubstringCounts();
+    }
+
+    // Запросы - по возрастанию order_len, тогда бинпоиск каждый раз начинается с ответа предыдущего
+    std::vector<std::pair<size_t, size_t>> order(order_lens.size());
+    for (size_t i = 0; i < order.size(); ++i) {
+        order[i] = {order_lens[i], i};
+    }
+    std::sort(order.begin(), order.end());
+
+    auto from = n_of_common_substrings_.begin();
+    for (auto & query : order) {
+        size_t order_len = query.first;
+        from = std::lower_bound(from, n_of_common_substrings_.end(), order_len);
+        if (from == n_of_common_substrings_.end()) {
+            break;
+        }
+        if (order_len == 0) {
+            continue;
+        }
+
+        size_t i = common_substring_positions_[from - n_of_common_substrings_.begin()];
+        result[query.second] = text_.substr(suffix_array_[i], LCP_[i] - (*from - order_len));
+    }
+    return result;
+}
+
+std::optional<std::string> SuffixArray::longestCommonSubstring(size_t min_n_of_strings) const {
+    if (min_n_of_strings == 0 || min_n_of_strings > n_of_strings_) {
+        return { };
+    }
+
+    if (min_n_of_strings == 1) {
+        // Самая длинная подстрока одной строки - самая длинная строка
+        size_t longest = std::max_element(length_of_strings_.begin(), length_of_strings_.end()) - length_of_strings_.begin();
+        if (length_of_strings_[longest] == 1) {
+            return { };
+        }
+        return text_.substr(end_of_strings_[longest] - (length_of_strings_[longest] - 1), length_of_strings_[longest] - 1);
+    }
+
+    // Окно [left, right] суффиксного массива двигаем слева направо. Для каждого right сжимаем окно слева,
+    // пока в нём остаются суффиксы min_n_of_strings разных строк. Тогда общий префикс суффиксов окна -
+    // минимум LCP_ на [left, right - 1] - подстрока из min_n_of_strings строк, минимум поддерживаем очередью.
+    // Первые n_of_strings_ суффиксов начинаются с разделителей, их пропускаем.
+    PackedArray documents(document_words_.data(), document_width_);
+    std::vector<int> n_of_suffixes(n_of_strings_, 0); // сколько суффиксов каждой строки в окне
+    size_t n_of_covered_strings = 0;
+    std::deque<size_t> min_LCP; // позиции p из [left, right - 1], LCP_[p] возрастает
+
+    size_t best_begin = 0;
+    size_t best_length = 0;
+    size_t left = n_of_strings_;
+    for (size_t right = n_of_strings_; right < size_; ++right) {
+        if (n_of_suffixes[documents[right]]++ == 0) {
+            ++n_of_covered_strings;
+        }
+        if (right > left) {
+            while (!min_LCP.empty() && LCP_[min_LCP.back()] >= LCP_[right - 1]) {
+                min_LCP.pop_back();
+            }
+            min_LCP.push_back(right - 1);
+        }
+
+        while (left < right && (n_of_suffixes[documents[left]] > 1 || n_of_covered_strings > min_n_of_strings)) {
+            if (--n_of_suffixes[documents[left]] == 0) {
+                --n_of_covered_strings;
+            }
+            ++left;
+            while (!min_LCP.empty() && min_LCP.front() < left) {
+                min_LCP.pop_front();
+            }
+        }
+
+        if (n_of_covered_strings >= min_n_of_strings && static_cast<size_t>(LCP_[min_LCP.front()]) > best_length) {
+            best_length = LCP_[min_LCP.front()];
+            best_begin = suffix_array_[right];
+        }
+    }
+
+    // Общей непустой подстроки у min_n_of_strings строк нет
+    if (best_length == 0) {
+        return { };
+    }
+    return text_.substr(best_begin, best_length);
+}
+
+std::vector<uint64_t> SuffixArray::calcDifferentSubstringsOfStrings() const {
+    // Различных подстрок строки длины L: L * (L + 1) / 2 минус lcp соседних в суффиксном массиве суффиксов
+    // этой строки. lcp двух суффиксов - минимум LCP_ между ними. Для текущего i держим стек позиций p < i,
+    // на которых достигаются минимумы LCP_[p ... i - 1] (значения в стеке возрастают), и минимум от
+    // предыдущего суффикса той же строки ищем в нём бинпоиском.
+    PackedArray documents(document_words_.data(), document_width_);
+    std::vector<uint64_t> n_of_substrings(n_of_strings_);
+    for (size_t i = 0; i < n_of_strings_; ++i) {
+        uint64_t length = length_of_strings_[i] - 1;
+        n_of_substrings[i] = length * (length + 1) / 2;
+    }
+
+    std::vector<long> previous(n_of_strings_, -1); // последний встреченный суффикс строки
+    std::vector<size_t> min_positions;
+    for (size_t i = n_of_strings_; i < size_; ++i) {
+        if (i > n_of_strings_) {
+            while (!min_positions.empty() && LCP_[min_positions.back()] >= LCP_[i - 1]) {
+                min_positions.pop_back();
+            }
+            min_positions.push_back(i - 1);
+        }
+
+        size_t document = documents[i];
+        if (previous[document] >= 0) {
+            auto min_position = std::lower_bound(min_positions.begin(), min_positions.end(),
+                                                 static_cast<size_t>(previous[document]));
+            n_of_substrings[document] -= LCP_[*min_position];
+        }
+        previous[document] = i;
+    }
+
+    return n_of_substrings;
+}
+
+class MappedFile {
+private:
+    const char * data_ = nullptr;
+    size_t size_ = 0;
+
+public:
+    explicit MappedFile(const std::string & filename) {
+        int fd = open(filename.c_str(), O_RDONLY);
+        if (fd < 0) {
+            perror(filename.c_str());
+            return;
+        }
+
+        struct stat file_stat{};
+        if (fstat(fd, &file_stat) == 0 && file_stat.st_size > 0) {
+            void * data = mmap(nullptr, file_stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (data != MAP_FAILED) {
+                data_ = static_cast<const char*>(data);
+                size_ = file_stat.st_size;
+                madvise(data, size_, MADV_SEQUENTIAL);
+            }
+            else {
+                perror(filename.c_str());
+            }
+        }
+        close(fd);
+    }
+    ~MappedFile() {
+        if (data_ != nullptr) {
+            munmap(const_cast<char*>(data_), size_);
+        }
+    }
+    MappedFile(const MappedFile &) = delete;
+    MappedFile & operator=(const MappedFile &) = delete;
+
+    const char * data() const {
+        return data_;
+    }
+    size_t size() const {
+        return size_;
+    }
+};
+
+// Формат файла индекса (порядок байт - как в памяти машины, каждая часть выровнена на 8 байт):
+//   SuffixArrayIndexHeader,
+//   text_ (size байт, вместе с '#'), дополненный нулями,
+//   suffix_array_[0], suffix_array_[s], suffix_array_[2s], ... по sa_width бит, где s = sa_sample_rate,
+//   LCP_ (size - 1 чисел по lcp_width бит).
+// Для двух строк text_ = text1 + '$' + text2 + '#', n_of_strings = 2, first_string_size = |text1| + 1.
+struct SuffixArrayIndexHeader {
+    char magic[4];
+    uint32_t version;
+    uint64_t size;
+    uint32_t sa_width;
+    uint32_t lcp_width;
+    uint32_t sa_sample_rate;
+    uint32_t n_of_strings;
+    uint64_t first_string_size;
+};
+
+const char SUFFIX_ARRAY_INDEX_MAGIC[4] = {'S', 'A', 'I', 'X'};
+const uint32_t SUFFIX_ARRAY_INDEX_VERSION = 1;
+
+size_t alignTo8(size_t size) {
+    return (size + 7) & ~size_t(7);
+}
+
+bool SuffixArray::save(const std::string & filename) const {
+    std::ofstream file(filename, std::ios_base::out | std::ios_base::trunc | std::ios_base::binary);
+    if (!file) {
+        perror(filename.c_str());
+        return false;
+    }
+
+    SuffixArrayIndexHeader header{};
+    memcpy(header.magic, SUFFIX_ARRAY_INDEX_MAGIC, sizeof(header.magic));
+    header.version = SUFFIX_ARRAY_INDEX_VERSION;
+    header.size = size_;
+    header.sa_width = bitWidth(size_ - 1);
+    header.lcp_width = bitWidth(LCP_.empty() ? 0 : *std::max_element(LCP_.begin(), LCP_.end()));
+    header.sa_sample_rate = 1;
+    header.n_of_strings = n_of_strings_;
+    header.first_string_size = length_of_strings_.empty() ? size_ : length_of_strings_[0];
+
+    std::string padded_text = text_;
+    padded_text.resize(alignTo8(padded_text.size()), '\0');
+    auto suffix_array_words = PackedArray::pack(suffix_array_, header.sa_sample_rate, header.sa_width);
+    auto LCP_words = PackedArray::pack(LCP_, 1, header.lcp_width);
+
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.write(padded_text.data(), padded_text.size());
+    file.write(reinterpret_cast<const char*>(suffix_array_words.data()), suffix_array_words.size() * sizeof(uint64_t));
+    file.write(reinterpret_cast<const char*>(LCP_words.data()), LCP_words.size() * sizeof(uint64_t));
+
+    return static_cast<bool>(file);
+}
+
+// Суффиксный массив и LCP, записанные SuffixArray::save(). Файл отображается в память,
+// части индекса читаются прямо из него, поэтому открытие не зависит от длины текста.
+class SuffixArrayIndex {
+private:
+    MappedFile file_;
+    const SuffixArrayIndexHeader * header_ = nullptr;
+    const char * text_ = nullptr;
+    PackedArray suffix_array_samples_;
+    PackedArray LCP_;
+
+public:
+    explicit SuffixArrayIndex(const std::string & filename);
+
+    bool isOpen() const {
+        return header_ != nullptr;
+    }
+
+    // Размер текста вместе с '#'
+    size_t size() const {
+        return header_->size;
+    }
+
+    [[nodiscard]] std::optional<std::string> orderedCommonSubstring(size_t order_len) const {
+        // Нужен полный суффиксный массив
+        if (header_->n_of_strings != 2 || header_->sa_sample_rate != 1) {
+            return { };
+        }
+        return findOrderedCommonSubstring(text_, suffix_array_samples_, LCP_, size(), header_->first_string_size - 1, order_len);
+    }
+
+    void printInfo(std::ostream & log_stream) const {
+        log_stream << "Text: " << size() - 1 << " symbols, " << header_->n_of_strings << " strings\n";
+        log_stream << "Suffix array: " << header_->sa_width << " bits, every " << header_->sa_sample_rate << " element\n";
+        log_stream << "LCP: " << header_->lcp_width << " bits\n";
+        log_stream << "File: " << file_.size() << " bytes" << std::endl;
+    }
+};
+
+SuffixArrayIndex::SuffixArrayIndex(const std::string & filename) : file_(filename) {
+    const char * data = file_.data();
+    size_t size = file_.size();
+
+    const auto * header = reinterpret_cast<const SuffixArrayIndexHeader*>(data);
+    if (size < sizeof(SuffixArrayIndexHeader) || memcmp(header->magic, SUFFIX_ARRAY_INDEX_MAGIC, sizeof(header->magic)) != 0
+        || header->version != SUFFIX_ARRAY_INDEX_VERSION || header->size == 0 || header->size > size
+        || header->first_string_size == 0 || header->first_string_size > header->size
+        || header->sa_sample_rate == 0 || header->sa_width > 32 || header->lcp_width > 32) {
+        return;
+    }
+
+    size_t n_of_samples = (header->size + header->sa_sample_rate - 1) / header->sa_sample_rate;
+    size_t text_offset = sizeof(SuffixArrayIndexHeader);
+    size_t suffix_array_offset = text_offset + alignTo8(header->size);
+    size_t LCP_offset = suffix_array_offset + PackedArray::wordsFor(n_of_samples, header->sa_width) * sizeof(uint64_t);
+    size_t end = LCP_offset + PackedArray::wordsFor(header->size - 1, header->lcp_width) * sizeof(uint64_t);
+    if (end > size) {
+        return;
+    }
+
+    header_ = header;
+    text_ = data + text_offset;
+    suffix_array_samples_ = PackedArray(reinterpret_cast<const uint64_t*>(data + suffix_array_offset), header->sa_width);
+    LCP_ = PackedArray(reinterpret_cast<const uint64_t*>(data + LCP_offset), header->lcp_width);
+}
+
+int main(int argc, char ** argv) {
+    std::string index_filename;
+    std::string build_filename;
+    size_t n_of_threads = 1;
+    size_t min_n_of_strings = 0;
+    std::string queries_filename;
+
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (strcmp(argv[i], "-j") == 0) {
+            // строить суффиксный массив и LCP в N потоков
+            n_of_threads = std::max(1ul, strtoul(argv[i + 1], nullptr, 10));
+        }
+        else if (strcmp(argv[i], "-b") == 0) {
+            build_filename = argv[i + 1];
+        }
+        else if (strcmp(argv[i], "-i") == 0) {
+            index_filename = argv[i + 1];
+        }
+        else if (strcmp(argv[i], "-m") == 0) {
+            // K строк: самая длинная подстрока хотя бы M из них и число различных подстрок каждой
+            min_n_of_strings = strtoul(argv[i + 1], nullptr, 10);
+        }
+        else if (strcmp(argv[i], "-k") == 0) {
+            queries_filename = argv[i + 1];
+        }
+    }
+
+    if (min_n_of_strings > 0) {
+        size_t n_of_strings = 0;
+        std::cin >> n_of_strings;
+        std::vector<std::string> texts(n_of_strings);
+        for (auto & text : texts) {
+            std::cin >> text;
+        }
+        if (texts.empty()) {
+            return 1;
+        }
+
+        SuffixArray suffix_array(texts, n_of_threads > 1 ? SuffixArray::Builder::radixDoubling : SuffixArray::Builder::sais, n_of_threads);
+        std::cout << suffix_array.longestCommonSubstring(min_n_of_strings).value_or("-1") << '\n';
+        for (auto n_of_substrings : suffix_array.calcDifferentSubstringsOfStrings()) {
+            std::cout << n_of_substrings << ' ';
+        }
+        std::cout << std::endl;
+        return 0;
+    }
 
-int main() {
-    std::string text1, text2;
     size_t k;
 
-    std::cin >> text1 >> text2 >> k;
+    if (!index_filename.empty()) {
+        // Ответ по готовому индексу, из ввода читается только k
+        SuffixArrayIndex index(index_filename);
+        if (!index.isOpen()) {
+            std::cerr << index_filename << ": not a suffix array index" << std::endl;
+            return 1;
+        }
+        std::cin >> k;
+        std::cout << index.orderedCommonSubstring(k).value_or("-1");
+        return 0;
+    }
+
+    std::string text1, text2;
+    std::cin >> text1 >> text2;
+
+    SuffixArray suffix_array(text1, text2, n_of_threads > 1 ? SuffixArray::Builder::radixDoubling : SuffixArray::Builder::sais, n_of_threads);
+
+    if (!build_filename.empty()) {
+        if (!suffix_array.save(build_filename)) {
+            return 1;
+        }
+        SuffixArrayIndex(build_filename).printInfo(std::cerr);
+        return 0;
+    }
+
+    if (!queries_filename.empty()) {
+        // Много k из файла, по одному на строку, ответы - по одному на строку
+        std::ifstream queries_file(queries_filename);
+        if (!queries_file) {
+            perror(queries_filename.c_str());
+            return 1;
+        }
+        std::vector<size_t> order_lens;
+        while (queries_file >> k) {
+            order_lens.push_back(k);
+        }
+
+        std::string output;
+        for (auto & substring : suffix_array.orderedCommonSubstrings(order_lens)) {
+            output += substring.value_or("-1");
+            output += '\n';
+        }
+        std::cout << output;
+        return 0;
+    }
 
-    SuffixArray suffix_array(text1, text2);
+    std::cin >> k;
     std::cout << suffix_array.orderedCommonSubstring(k).value_or("-1");
 
     return 0;
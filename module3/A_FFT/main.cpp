@@ -24,6 +24,12 @@
 #include <cstring>
 #include <algorithm>
 #include <cassert>
+#include <chrono>
+#include <map>
+#include <memory>
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
 
 
 // Структура, описывающая заголовок WAV файла.
@@ -94,6 +100,8 @@ struct {
 class WavProcessor;
 // Класс, отвечающий за чтение, храние wav файлов в оперативной памяти и запись их в файловую систему.
 class WavFile;
+// План быстрого преобразования Фурье над раздельными массивами вещественных и мнимых частей.
+class FFTPlan;
 
 // Класс, отвечающий за чтение, храние wav файлов в оперативной памяти и запись их в файловую систему.
 class WavFile{
@@ -190,7 +198,7 @@ private:
     }
 
     void readData(std::ifstream & file) {
-        assert(("I do not support more than 8 bytes per sample!", header.bits_per_sample / 8 <= 8));
+        assert(header.bits_per_sample / 8 <= 8 && "I do not support more than 8 bytes per sample!");
 
         channels.resize(header.num_channels);
 
@@ -264,6 +272,531 @@ private:
     }
 };
 
+// Векторы из double для ядер FFT с одинаковым интерфейсом: ScalarDouble - одно число,
+// SimdDouble - самый широкий вектор, доступный при компиляции: с -mavx2 -mfma (или -march=native)
+// это AVX2 по 4 числа с FMA, иначе SSE2 по 2 числа.
+struct ScalarDouble {
+    static constexpr size_t SIZE = 1;
+    static constexpr const char * NAME = "scalar";
+    double v;
+
+    static ScalarDouble load(const double * p) { return {*p}; }
+    static ScalarDouble broadcast(double x) { return {x}; }
+    void store(double * p) const { *p = v; }
+
+    friend ScalarDouble operator+(ScalarDouble a, ScalarDouble b) { return {a.v + b.v}; }
+    friend ScalarDouble operator-(ScalarDouble a, ScalarDouble b) { return {a.v - b.v}; }
+    friend ScalarDouble operator*(ScalarDouble a, ScalarDouble b) { return {a.v * b.v}; }
+    // a * b + c и a * b - c
+    static ScalarDouble mulAdd(ScalarDouble a, ScalarDouble b, ScalarDouble c) { return {a.v * b.v + c.v}; }
+    static ScalarDouble mulSub(ScalarDouble a, ScalarDouble b, ScalarDouble c) { return {a.v * b.v - c.v}; }
+    // Транспонирует матрицу SIZE x SIZE из векторов rows[0 ... SIZE)
+    static void transpose(ScalarDouble *) {}
+};
+
+#if defined(__AVX2__) && defined(__FMA__)
+struct SimdDouble {
+    static constexpr size_t SIZE = 4;
+    static constexpr const char * NAME = "AVX2/FMA";
+    __m256d v;
+
+    static SimdDouble load(const double * p) { return {_mm256_loadu_pd(p)}; }
+    static SimdDouble broadcast(double x) { return {_mm256_set1_pd(x)}; }
+    void store(double * p) const { _mm256_storeu_pd(p, v); }
+
+    friend SimdDouble operator+(SimdDouble a, SimdDouble b) { return {_mm256_add_pd(a.v, b.v)}; }
+    friend SimdDouble operator-(SimdDouble a, SimdDouble b) { return {_mm256_sub_pd(a.v, b.v)}; }
+    friend SimdDouble operator*(SimdDouble a, SimdDouble b) { return {_mm256_mul_pd(a.v, b.v)}; }
+    static SimdDouble mulAdd(SimdDouble a, SimdDouble b, SimdDouble c) { return {_mm256_fmadd_pd(a.v, b.v, c.v)}; }
+    static SimdDouble mulSub(SimdDouble a, SimdDouble b, SimdDouble c) { return {_mm256_fmsub_pd(a.v, b.v, c.v)}; }
+    static void transpose(SimdDouble * rows) {
+        __m256d t0 = _mm256_unpacklo_pd(rows[0].v, rows[1].v);
+        __m256d t1 = _mm256_unpackhi_pd(rows[0].v, rows[1].v);
+        __m256d t2 = _mm256_unpacklo_pd(rows[2].v, rows[3].v);
+        __m256d t3 = _mm256_unpackhi_pd(rows[2].v, rows[3].v);
+        rows[0].v = _mm256_permute2f128_pd(t0, t2, 0x20);
+        rows[1].v = _mm256_permute2f128_pd(t1, t3, 0x20);
+        rows[2].v = _mm256_permute2f128_pd(t0, t2, 0x31);
+        rows[3].v = _mm256_permute2f128_pd(t1, t3, 0x31);
+    }
+};
+#elif defined(__SSE2__)
+struct SimdDouble {
+    static constexpr size_t SIZE = 2;
+    static constexpr const char * NAME = "SSE2";
+    __m128d v;
+
+    static SimdDouble load(const double * p) { return {_mm_loadu_pd(p)}; }
+    static SimdDouble broadcast(double x) { return {_mm_set1_pd(x)}; }
+    void store(double * p) const { _mm_storeu_pd(p, v); }
+
+    friend SimdDouble operator+(SimdDouble a, SimdDouble b) { return {_mm_add_pd(a.v, b.v)}; }
+    friend SimdDouble operator-(SimdDouble a, SimdDouble b) { return {_mm_sub_pd(a.v, b.v)}; }
+    friend SimdDouble operator*(SimdDouble a, SimdDouble b) { return {_mm_mul_pd(a.v, b.v)}; }
+    static SimdDouble mulAdd(SimdDouble a, SimdDouble b, SimdDouble c) { return {_mm_add_pd(_mm_mul_pd(a.v, b.v), c.v)}; }
+    static SimdDouble mulSub(SimdDouble a, SimdDouble b, SimdDouble c) { return {_mm_sub_pd(_mm_mul_pd(a.v, b.v), c.v)}; }
+    static void transpose(SimdDouble * rows) {
+        __m128d t0 = _mm_unpacklo_pd(rows[0].v, rows[1].v);
+        rows[1].v = _mm_unpackhi_pd(rows[0].v, rows[1].v);
+        rows[0].v = t0;
+    }
+};
+#else
+typedef ScalarDouble SimdDouble;
+#endif
+
+// План быстрого преобразования Фурье размера n = 2^k над раздельными массивами
+// вещественных и мнимых частей (structure of arrays: соседние числа лежат в соседних ячейках вектора).
+// Знак экспоненты и нормировка такие же, как у WavProcessor::fft.
+class FFTPlan{
+public:
+    enum class Kind {
+        radix2,
+        radix4,
+        radix8,
+        splitRadix,
+        // замерить все варианты и выбрать самый быстрый
+        measure
+    };
+
+    explicit FFTPlan(size_t n, Kind kind = Kind::measure) : n_(n) {
+        assert(n > 0 && (n & (n - 1)) == 0 && "FFT size must be a power of two");
+
+        if (kind == Kind::measure) {
+            kind = fastestKind(n);
+        }
+        kind_ = kind;
+
+        if (kind_ == Kind::splitRadix) {
+            buildSplitRadix();
+        }
+        else {
+            buildStockham(kind_ == Kind::radix2 ? 2 : kind_ == Kind::radix4 ? 4 : 8);
+        }
+    }
+
+    static const char * name(Kind kind) {
+        switch (kind) {
+            case Kind::radix2:
+                return "radix-2";
+            case Kind::radix4:
+                return "radix-4";
+            case Kind::radix8:
+                return "radix-8";
+            case Kind::splitRadix:
+                return "split-radix";
+            default:
+                return "measure";
+        }
+    }
+
+    // Вариант по имени из name(), false - если такого нет
+    static bool kindByName(const std::string & kind_name, Kind & kind) {
+        for (Kind candidate : {Kind::radix2, Kind::radix4, Kind::radix8, Kind::splitRadix, Kind::measure}) {
+            if (kind_name == name(candidate)) {
+                kind = candidate;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    Kind kind() const {
+        return kind_;
+    }
+
+    size_t size() const {
+        return n_;
+    }
+
+    // Преобразование на месте, invert - обратное (с делением на n)
+    void execute(double * re, double * im, bool invert) {
+        // Обратное преобразование - это прямое, у которого поменяли местами вещественные и мнимые части
+        // на входе и на выходе. В раздельных массивах это просто обмен указателей.
+        if (invert) {
+            std::swap(re, im);
+        }
+
+        if (kind_ == Kind::splitRadix) {
+            splitRadix(re, im, n_, 0);
+            bitReverse(re, im);
+        }
+        else {
+            stockham(re, im);
+        }
+
+        if (invert) {
+            double scale = 1.0 / n_;
+            for (size_t i = 0; i < n_; ++i) {
+                re[i] *= scale;
+                im[i] *= scale;
+            }
+        }
+    }
+
+private:
+    // Размер, на котором сравниваются варианты: дальше соотношение скоростей почти не меняется,
+    // а замер на полном размере стоил бы нескольких преобразований
+    constexpr static size_t MEASURE_SIZE = 1u << 18u;
+    constexpr static double MEASURE_TIME = 0.002;
+
+    // Этап алгоритма Стокхэма: подзадачи длины length разбиваются на radix подзадач длины length / radix.
+    // twiddle_*[(t - 1) * m + p] = W^(p t), W = exp(2 pi i / length), m = length / radix
+    struct Stage {
+        size_t radix;
+        size_t length;
+        std::vector<double> twiddle_re;
+        std::vector<double> twiddle_im;
+    };
+    // Множители split-radix для подзадачи длины length: W^k и W^3k, k < length / 4
+    struct SplitTwiddles {
+        std::vector<double> re1;
+        std::vector<double> im1;
+        std::vector<double> re3;
+        std::vector<double> im3;
+    };
+
+    size_t n_;
+    Kind kind_;
+    std::vector<Stage> stages_;
+    std::vector<SplitTwiddles> split_twiddles_;
+    std::vector<double> work_re_;
+    std::vector<double> work_im_;
+
+    static Kind fastestKind(size_t n) {
+        size_t size = std::min(n, MEASURE_SIZE);
+        std::vector<double> re(size), im(size);
+
+        Kind best = Kind::radix2;
+        double best_time = 0;
+        for (Kind kind : {Kind::radix2, Kind::radix4, Kind::radix8, Kind::splitRadix}) {
+            FFTPlan plan(size, kind);
+            // лучшее время из нескольких запусков, не меньше 3 и не меньше MEASURE_TIME секунд в сумме
+            double time = 0;
+            double total = 0;
+            for (int i = 0; i < 3 || total < MEASURE_TIME; ++i) {
+                auto start = std::chrono::steady_clock::now();
+                plan.execute(re.data(), im.data(), false);
+                double duration = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+                time = i == 0 ? duration : std::min(time, duration);
+                total += duration;
+            }
+            if (kind == Kind::radix2 || time < best_time) {
+                best = kind;
+                best_time = time;
+            }
+        }
+        return best;
+    }
+
+    void buildStockham(size_t radix) {
+        // Этапы с основанием radix, остаток (2 или 4) - последним этапом, где шаг по памяти уже большой
+        size_t length = n_;
+        while (length > 1) {
+            size_t stage_radix = radix;
+            while (length % stage_radix != 0) {
+                stage_radix /= 2;
+            }
+
+            Stage stage{stage_radix, length, {}, {}};
+            size_t m = length / stage_radix;
+            stage.twiddle_re.resize((stage_radix - 1) * m);
+            stage.twiddle_im.resize((stage_radix - 1) * m);
+            for (size_t t = 1; t < stage_radix; ++t) {
+                for (size_t p = 0; p < m; ++p) {
+                    auto w = std::polar(1.0, 2 * M_PI * static_cast<double>(p * t) / length);
+                    stage.twiddle_re[(t - 1) * m + p] = w.real();
+                    stage.twiddle_im[(t - 1) * m + p] = w.imag();
+                }
+            }
+            stages_.push_back(std::move(stage));
+            length /= stage_radix;
+        }
+        work_re_.resize(n_);
+        work_im_.resize(n_);
+    }
+
+    void buildSplitRadix() {
+        for (size_t length = n_; length >= 4; length /= 2) {
+            size_t m = length / 4;
+            SplitTwiddles twiddles;
+            twiddles.re1.resize(m);
+            twiddles.im1.resize(m);
+            twiddles.re3.resize(m);
+            twiddles.im3.resize(m);
+            for (size_t k = 0; k < m; ++k) {
+                auto w1 = std::polar(1.0, 2 * M_PI * static_cast<double>(k) / length);
+                auto w3 = std::polar(1.0, 2 * M_PI * static_cast<double>(3 * k) / length);
+                twiddles.re1[k] = w1.real();
+                twiddles.im1[k] = w1.imag();
+                twiddles.re3[k] = w3.real();
+                twiddles.im3[k] = w3.imag();
+            }
+            split_twiddles_.push_back(std::move(twiddles));
+        }
+    }
+
+    // (re + i im) *= (w_re + i w_im)
+    template<class V>
+    static void multiply(V & re, V & im, V w_re, V w_im) {
+        V product_re = V::mulSub(re, w_re, im * w_im);
+        im = V::mulAdd(re, w_im, im * w_re);
+        re = product_re;
+    }
+
+    void stockham(double * re, double * im) {
+        // Автосортировка Стокхэма: каждый этап читает из одного буфера и пишет в другой, перестановка
+        // бит-реверса не нужна. На этапе с шагом stride соседние по памяти числа - независимые подзадачи,
+        // поэтому внутренний цикл векторизуется по ним целиком, как только stride делится на ширину вектора.
+        // Первый этап (stride = 1) векторизуется по подзадачам, остальные узкие этапы считаются по одному числу.
+        double * x_re = re;
+        double * x_im = im;
+        double * y_re = work_re_.data();
+        double * y_im = work_im_.data();
+
+        size_t stride = 1;
+        for (const auto & stage : stages_) {
+            if (stride % SimdDouble::SIZE == 0) {
+                runStage<SimdDouble>(stage, stride, x_re, x_im, y_re, y_im);
+            }
+            else if (stride == 1 && stage.radix % SimdDouble::SIZE == 0 && stage.length / stage.radix % SimdDouble::SIZE == 0) {
+                runFirstStage(stage, x_re, x_im, y_re, y_im);
+            }
+            else {
+                runStage<ScalarDouble>(stage, stride, x_re, x_im, y_re, y_im);
+            }
+            std::swap(x_re, y_re);
+            std::swap(x_im, y_im);
+            stride *= stage.radix;
+        }
+
+        if (x_re != re) {
+            std::copy(x_re, x_re + n_, re);
+            std::copy(x_im, x_im + n_, im);
+        }
+    }
+
+    template<class V>
+    static void runStage(const Stage & stage, size_t stride, const double * x_re, const double * x_im, double * y_re, double * y_im) {
+        switch (stage.radix) {
+            case 2:
+                return stageByStride<2, V>(stage, stride, x_re, x_im, y_re, y_im);
+            case 4:
+                return stageByStride<4, V>(stage, stride, x_re, x_im, y_re, y_im);
+            default:
+                return stageByStride<8, V>(stage, stride, x_re, x_im, y_re, y_im);
+        }
+    }
+
+    static void runFirstStage(const Stage & stage, const double * x_re, const double * x_im, double * y_re, double * y_im) {
+        switch (stage.radix) {
+            case 2:
+                return stageBySubproblem<2, SimdDouble>(stage, x_re, x_im, y_re, y_im);
+            case 4:
+                return stageBySubproblem<4, SimdDouble>(stage, x_re, x_im, y_re, y_im);
+            default:
+                return stageBySubproblem<8, SimdDouble>(stage, x_re, x_im, y_re, y_im);
+        }
+    }
+
+    // Кодлет: преобразование длины RADIX с корнем e^(2 pi i / RADIX) на месте, выход t - в ячейке t
+    template<size_t RADIX, class V>
+    static void butterfly(V * re, V * im) {
+        if constexpr (RADIX == 2) {
+            V sum_re = re[0] + re[1], sum_im = im[0] + im[1];
+            re[1] = re[0] - re[1];
+            im[1] = im[0] - im[1];
+            re[0] = sum_re;
+            im[0] = sum_im;
+        }
+        else if constexpr (RADIX == 4) {
+            // умножение на i - это (re, im) -> (-im, re)
+            V sum_ac_re = re[0] + re[2], sum_ac_im = im[0] + im[2];
+            V diff_ac_re = re[0] - re[2], diff_ac_im = im[0] - im[2];
+            V sum_bd_re = re[1] + re[3], sum_bd_im = im[1] + im[3];
+            V diff_bd_re = re[1] - re[3], diff_bd_im = im[1] - im[3];
+
+            re[0] = sum_ac_re + sum_bd_re;
+            im[0] = sum_ac_im + sum_bd_im;
+            re[1] = diff_ac_re - diff_bd_im;
+            im[1] = diff_ac_im + diff_bd_re;
+            re[2] = sum_ac_re - sum_bd_re;
+            im[2] = sum_ac_im - sum_bd_im;
+            re[3] = diff_ac_re + diff_bd_im;
+            im[3] = diff_ac_im - diff_bd_re;
+        }
+        else {
+            // Длина 8 = бабочки длины 2 (a_k, a_{k+4}), поворот разностей на e^(i pi k / 4)
+            // и два преобразования длины 4: суммы дают чётные выходы, разности - нечётные
+            const V SQRT1_2 = V::broadcast(M_SQRT1_2);
+            V even_re[4], even_im[4], odd_re[4], odd_im[4];
+            #pragma GCC unroll 8
+            for (size_t k = 0; k < 4; ++k) {
+                even_re[k] = re[k] + re[k + 4];
+                even_im[k] = im[k] + im[k + 4];
+                odd_re[k] = re[k] - re[k + 4];
+                odd_im[k] = im[k] - im[k + 4];
+            }
+            // e^(i pi / 4) = (1 + i) / sqrt(2), e^(i pi / 2) = i, e^(3 i pi / 4) = (-1 + i) / sqrt(2)
+            V rotated_re = (odd_re[1] - odd_im[1]) * SQRT1_2;
+            odd_im[1] = (odd_re[1] + odd_im[1]) * SQRT1_2;
+            odd_re[1] = rotated_re;
+            rotated_re = V::broadcast(0) - odd_im[2];
+            odd_im[2] = odd_re[2];
+            odd_re[2] = rotated_re;
+            rotated_re = (V::broadcast(0) - odd_re[3] - odd_im[3]) * SQRT1_2;
+            odd_im[3] = (odd_re[3] - odd_im[3]) * SQRT1_2;
+            odd_re[3] = rotated_re;
+
+            butterfly<4>(even_re, even_im);
+            butterfly<4>(odd_re, odd_im);
+            #pragma GCC unroll 8
+            for (size_t u = 0; u < 4; ++u) {
+                re[2 * u] = even_re[u];
+                im[2 * u] = even_im[u];
+                re[2 * u + 1] = odd_re[u];
+                im[2 * u + 1] = odd_im[u];
+            }
+        }
+    }
+
+    // Этап для подзадачи p и всех q < stride берёт x[q + stride (p + t m)], t < RADIX, делает преобразование
+    // длины RADIX, умножает выход t на W^(p t) и пишет в y[q + stride (RADIX p + t)]. Вектор - соседние q.
+    template<size_t RADIX, class V>
+    static void stageByStride(const Stage & stage, size_t stride, const double * x_re, const double * x_im, double * y_re, double * y_im) {
+        size_t m = stage.length / RADIX;
+        for (size_t p = 0; p < m; ++p) {
+            V w_re[RADIX - 1], w_im[RADIX - 1];
+            #pragma GCC unroll 8
+            for (size_t t = 1; t < RADIX; ++t) {
+                w_re[t - 1] = V::broadcast(stage.twiddle_re[(t - 1) * m + p]);
+                w_im[t - 1] = V::broadcast(stage.twiddle_im[(t - 1) * m + p]);
+            }
+
+            for (size_t q = 0; q < stride; q += V::SIZE) {
+                V re[RADIX], im[RADIX];
+                #pragma GCC unroll 8
+                for (size_t t = 0; t < RADIX; ++t) {
+                    re[t] = V::load(x_re + stride * (p + t * m) + q);
+                    im[t] = V::load(x_im + stride * (p + t * m) + q);
+                }
+                butterfly<RADIX>(re, im);
+                #pragma GCC unroll 8
+                for (size_t t = 0; t < RADIX; ++t) {
+                    if (t > 0) {
+                        multiply(re[t], im[t], w_re[t - 1], w_im[t - 1]);
+                    }
+                    re[t].store(y_re + stride * (RADIX * p + t) + q);
+                    im[t].store(y_im + stride * (RADIX * p + t) + q);
+                }
+            }
+        }
+    }
+
+    // Тот же этап при stride = 1: вектор - соседние подзадачи p, их выходы лежат с шагом RADIX,
+    // поэтому перед записью блоки V::SIZE x V::SIZE транспонируются
+    template<size_t RADIX, class V>
+    static void stageBySubproblem(const Stage & stage, const double * x_re, const double * x_im, double * y_re, double * y_im) {
+        if constexpr (RADIX % V::SIZE == 0) {
+            size_t m = stage.length / RADIX;
+            for (size_t p = 0; p < m; p += V::SIZE) {
+                V re[RADIX], im[RADIX];
+                #pragma GCC unroll 8
+                for (size_t t = 0; t < RADIX; ++t) {
+                    re[t] = V::load(x_re + p + t * m);
+                    im[t] = V::load(x_im + p + t * m);
+                }
+                butterfly<RADIX>(re, im);
+                #pragma GCC unroll 8
+                for (size_t t = 1; t < RADIX; ++t) {
+                    multiply(re[t], im[t], V::load(stage.twiddle_re.data() + (t - 1) * m + p),
+                             V::load(stage.twiddle_im.data() + (t - 1) * m + p));
+                }
+                #pragma GCC unroll 8
+                for (size_t t = 0; t < RADIX; t += V::SIZE) {
+                    V::transpose(re + t);
+                    V::transpose(im + t);
+                    #pragma GCC unroll 8
+                    for (size_t j = 0; j < V::SIZE; ++j) {
+                        re[t + j].store(y_re + RADIX * (p + j) + t);
+                        im[t + j].store(y_im + RADIX * (p + j) + t);
+                    }
+                }
+            }
+        }
+    }
+
+    void splitRadix(double * re, double * im, size_t length, size_t level) {
+        // Рекурсивный split-radix с прореживанием по частоте, на месте: чётные выходы - преобразование
+        // длины length / 2 от x_k + x_{k + length / 2}, выходы 4k + 1 и 4k + 3 - преобразования длины length / 4.
+        // Результат получается в порядке бит-реверса, как у обычного radix-2 на месте.
+        if (length == 1) {
+            return;
+        }
+        if (length == 2) {
+            double a_re = re[0], a_im = im[0];
+            re[0] = a_re + re[1];
+            im[0] = a_im + im[1];
+            re[1] = a_re - re[1];
+            im[1] = a_im - im[1];
+            return;
+        }
+
+        if (length / 4 % SimdDouble::SIZE == 0) {
+            splitRadixButterflies<SimdDouble>(re, im, length, split_twiddles_[level]);
+        }
+        else {
+            splitRadixButterflies<ScalarDouble>(re, im, length, split_twiddles_[level]);
+        }
+
+        splitRadix(re, im, length / 2, level + 1);
+        splitRadix(re + length / 2, im + length / 2, length / 4, level + 2);
+        splitRadix(re + 3 * length / 4, im + 3 * length / 4, length / 4, level + 2);
+    }
+
+    template<class V>
+    static void splitRadixButterflies(double * re, double * im, size_t length, const SplitTwiddles & twiddles) {
+        size_t m = length / 4;
+        for (size_t k = 0; k < m; k += V::SIZE) {
+            V a_re = V::load(re + k), a_im = V::load(im + k);
+            V b_re = V::load(re + m + k), b_im = V::load(im + m + k);
+            V c_re = V::load(re + 2 * m + k), c_im = V::load(im + 2 * m + k);
+            V d_re = V::load(re + 3 * m + k), d_im = V::load(im + 3 * m + k);
+
+            (a_re + c_re).store(re + k);
+            (a_im + c_im).store(im + k);
+            (b_re + d_re).store(re + m + k);
+            (b_im + d_im).store(im + m + k);
+
+            V diff_ac_re = a_re - c_re, diff_ac_im = a_im - c_im;
+            V diff_bd_re = b_re - d_re, diff_bd_im = b_im - d_im;
+            V u_re = diff_ac_re - diff_bd_im, u_im = diff_ac_im + diff_bd_re;
+            V v_re = diff_ac_re + diff_bd_im, v_im = diff_ac_im - diff_bd_re;
+            multiply(u_re, u_im, V::load(twiddles.re1.data() + k), V::load(twiddles.im1.data() + k));
+            multiply(v_re, v_im, V::load(twiddles.re3.data() + k), V::load(twiddles.im3.data() + k));
+
+            u_re.store(re + 2 * m + k);
+            u_im.store(im + 2 * m + k);
+            v_re.store(re + 3 * m + k);
+            v_im.store(im + 3 * m + k);
+        }
+    }
+
+    void bitReverse(double * re, double * im) const {
+        for (size_t i = 1, j = 0; i < n_; ++i) {
+            size_t bit = n_ >> 1;
+            for (; j & bit; bit >>= 1) {
+                j ^= bit;
+            }
+            j ^= bit;
+            if (i < j) {
+                std::swap(re[i], re[j]);
+                std::swap(im[i], im[j]);
+            }
+        }
+    }
+};
+
 // Класс, содержащий методы для редактирования wav файлов
 class WavProcessor{
     typedef std::complex<double> base;
@@ -271,7 +804,9 @@ class WavProcessor{
 public:
     WavProcessor() = delete;
 
-    static WavFile compress(WavFile file, double rate = 1.0) {
+    // kind - вариант FFT. По умолчанию он фиксирован, чтобы результат не зависел от замеров:
+    // разные варианты могут округлять отдельные сэмплы по-разному. Kind::measure - самый быстрый на этой машине.
+    static WavFile compress(WavFile file, double rate = 1.0, FFTPlan::Kind kind = FFTPlan::Kind::radix4) {
 
         for (size_t i_channel = 0; i_channel < file.header.num_channels; ++i_channel) {
             // выполним эти действия для всех каналов по отдельности.
@@ -283,31 +818,112 @@ public:
             // дополняем длину до 2^n
             complete2n(data, 0.0);
 
-            // создаем массив комплексных чисел
-            auto complex_data = makeComplex(data);
+            // вещественные части - сами данные, мнимые - нули
+            std::vector<double> imag(data.size(), 0.0);
+            auto & fft_plan = plan(data.size(), kind);
 
             // выполняем быстрое преобразование Фурье
-            fft(complex_data, false);
+            fft_plan.execute(data.data(), imag.data(), false);
 
             // обнуляем последнюю долю rate коэффициентов в разложении Фурье
-            for (size_t i = rate * complex_data.size(); i < complex_data.size(); ++i) {
-                complex_data[i] = 0;
+            for (size_t i = rate * data.size(); i < data.size(); ++i) {
+                data[i] = 0;
+                imag[i] = 0;
             }
 
             // выполняем обратное быстрое преобразование Фурье
-            fft(complex_data, true);
-
-            // получаем вектор действительных чисел
-            auto real = makeReal(complex_data);
+            fft_plan.execute(data.data(), imag.data(), true);
 
             // записываем измения в файл (пишем только нужный изначальный размер, помня, что сы увеличивали длину)
-            data = std::vector<double>(real.begin(), real.begin() + len);
+            data.resize(len);
         }
         return file;
     }
 
+    // Скорость FFT на случайных данных размеров 2^min_power ... 2^max_power: GFLOPS (5 n log2 n операций
+    // на преобразование) для каждого варианта плана, выбор планировщика и для fft на std::complex,
+    // а также наибольшее отклонение плана от fft
+    static void benchmarkFFT(size_t min_power, size_t max_power) {
+        const FFTPlan::Kind KINDS[] = {FFTPlan::Kind::radix2, FFTPlan::Kind::radix4, FFTPlan::Kind::radix8,
+                                       FFTPlan::Kind::splitRadix};
+
+        printf("SIMD: %s, GFLOPS\n", SimdDouble::NAME);
+        printf("%10s", "n");
+        for (auto kind : KINDS) {
+            printf("%12s", FFTPlan::name(kind));
+        }
+        printf("%12s%12s%12s\n", "complex", "plan", "error");
+
+        for (size_t power = min_power; power <= max_power; ++power) {
+            size_t n = size_t(1) << power;
+            std::vector<double> data(n);
+            for (auto & x : data) {
+                x = rand() % 65536 - 32768;
+            }
+            double flops = 5.0 * n * power;
+            printf("%10zu", n);
+
+            std::vector<double> re, im;
+            for (auto kind : KINDS) {
+                FFTPlan fft_plan(n, kind);
+                double time = measure([&]() {
+                    re = data;
+                    im.assign(n, 0.0);
+                }, [&]() {
+                    fft_plan.execute(re.data(), im.data(), false);
+                });
+                printf("%12.2f", flops / time * 1e-9);
+            }
+
+            std::vector<base> complex_data;
+            double time = measure([&]() {
+                complex_data = makeComplex(data);
+            }, [&]() {
+                fft(complex_data, false);
+            });
+            printf("%12.2f", flops / time * 1e-9);
+
+            auto & fft_plan = plan(n, FFTPlan::Kind::measure);
+            re = data;
+            im.assign(n, 0.0);
+            fft_plan.execute(re.data(), im.data(), false);
+            double error = 0;
+            for (size_t i = 0; i < n; ++i) {
+                error = std::max(error, std::abs(complex_data[i] - base(re[i], im[i])));
+            }
+            printf("%12s%12.1e\n", FFTPlan::name(fft_plan.kind()), error);
+            fflush(stdout);
+        }
+    }
+
 private:
 
+    // План FFT для размера n, строится (для Kind::measure - с замером вариантов) один раз на размер и вариант
+    static FFTPlan & plan(size_t n, FFTPlan::Kind kind) {
+        static std::map<std::pair<size_t, FFTPlan::Kind>, std::unique_ptr<FFTPlan>> plans;
+        auto & fft_plan = plans[{n, kind}];
+        if (!fft_plan) {
+            fft_plan = std::make_unique<FFTPlan>(n, kind);
+        }
+        return *fft_plan;
+    }
+
+    // Наименьшее время run() за несколько запусков (не меньше 3 и не меньше 0.2 с в сумме), перед каждым - prepare()
+    template<class Prepare, class Run>
+    static double measure(Prepare prepare, Run run) {
+        double best = 0;
+        double total = 0;
+        for (int i = 0; i < 3 || total < 0.2; ++i) {
+            prepare();
+            auto start = std::chrono::steady_clock::now();
+            run();
+            double duration = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            best = i == 0 ? duration : std::min(best, duration);
+            total += duration;
+        }
+        return best;
+    }
+
     template<typename T>
     static std::vector<base> makeComplex(const std::vector<T> & data) {
         std::vector<base> complex;
@@ -318,14 +934,6 @@ private:
         return complex;
     }
 
-    static std::vector<double> makeReal(const std::vector<base> & complex) {
-        std::vector<double> real;
-        real.reserve(complex.size());
-        for (const auto & i : complex) {
-            real.emplace_back(i.real());
-        }
-        return real;
-    }
     template<class T>
     static void complete2n(std::vector<T> & data, T new_item) {
         // Дополняет массив до длины 2^n элементами new_item
@@ -337,45 +945,73 @@ private:
         data.resize(n, new_item);
     }
 
+    // Корни из единицы для fft: roots[len + j] = exp(2 pi i j / (2 len)) для всех len = 2^k < n.
+    // Таблица строится один раз для наибольшего встреченного n и подходит для всех меньших размеров.
+    // Корни с чётным j берутся из предыдущего уровня, с нечётным - считаются через cos / sin,
+    // так что ошибка не накапливается, как при w *= w_n.
+    static const std::vector<base> & roots(size_t n) {
+        static std::vector<base> table(2, base(1));
+        while (table.size() < n) {
+            size_t len = table.size();
+            table.resize(2 * len);
+            for (size_t j = 0; j < len; ++j) {
+                table[len + j] = j % 2 == 0 ? table[len / 2 + j / 2] : std::polar(1.0, M_PI * j / len);
+            }
+        }
+        return table;
+    }
+
     static void fft (std::vector<base> & a, bool invert) {
         size_t n = a.size();
-        if (n == 1){
-            return;
-        }
 
-        std::vector<base> a0 (n/2),  a1 (n/2);
-        for (size_t i = 0, j = 0; i < n; i += 2, ++j) {
-            a0[j] = a[i];
-            a1[j] = a[i+1];
+        // Итеративный вариант без рекурсии и выделения памяти: сначала ставим каждый элемент на место,
+        // номер которого - его номер с обратным порядком бит, потом снизу вверх склеиваем соседние блоки длины len.
+        for (size_t i = 1, j = 0; i < n; ++i) {
+            size_t bit = n >> 1;
+            for (; j & bit; bit >>= 1) {
+                j ^= bit;
+            }
+            j ^= bit;
+            if (i < j) {
+                std::swap(a[i], a[j]);
+            }
         }
-        // Для достижения асимптотики O(n log n) воспользуемся принципом "разделяй и властвуй" и будем рекурсивно вызывать fft от половины данных.
-        fft (a0, invert);
-        fft (a1, invert);
-
-        double angle = 2 * M_PI / n * (invert ? -1 : 1);
-        base w (1),  w_n (cos(angle), sin(angle));
-        for (size_t i = 0; i < n / 2; ++i) {
-            a[i] = a0[i] + w * a1[i];
-            a[i+n/2] = a0[i] - w * a1[i];
 
-            if (invert) {
-                a[i] /= 2;
-                a[i+n/2] /= 2;
+        const auto & w = roots(n);
+        for (size_t len = 1; len < n; len <<= 1) {
+            for (size_t i = 0; i < n; i += 2 * len) {
+                for (size_t j = 0; j < len; ++j) {
+                    // Умножаем вручную: operator* у std::complex проверяет NaN и вызывается через __muldc3
+                    const base & root = w[len + j];
+                    const base & odd = a[i + j + len];
+                    base v(odd.real() * root.real() - odd.imag() * root.imag(),
+                           odd.real() * root.imag() + odd.imag() * root.real());
+                    a[i + j + len] = a[i + j] - v;
+                    a[i + j] += v;
+                }
             }
+        }
 
-            w *= w_n;
+        if (invert) {
+            // Обратное преобразование - это прямое, у которого коэффициенты 1 ... n - 1 идут в обратном порядке,
+            // делённое на n (один раз, а не на 2 на каждом уровне)
+            std::reverse(a.begin() + 1, a.end());
+            double scale = 1.0 / n;
+            for (auto & x : a) {
+                x *= scale;
+            }
         }
     }
 };
 
-void createAndCompress(const std::string & input_filename, const std::string & output_filename, double rate) {
+void createAndCompress(const std::string & input_filename, const std::string & output_filename, double rate, FFTPlan::Kind kind) {
     // функция, создающая файл, compressed с указанным rate
 
     WavFile input(input_filename);
 
     input.printInfo();
 
-    WavFile output = WavProcessor::compress(input, rate);
+    WavFile output = WavProcessor::compress(input, rate, kind);
     output.save(output_filename);
 
     std::cout << output_filename << " saved!\n" << std::endl;
@@ -385,6 +1021,25 @@ int main(int argc, char** argv) {
     const static double COMPRESS_RATE = 0.05;
     const static std::string OUT_PREFIX = "out_";
 
+    if (argc > 1 && strcmp(argv[1], "-b") == 0) {
+        // ./A_FFT -b [min_power [max_power]] - замер скорости FFT
+        size_t min_power = argc > 2 ? strtoul(argv[2], nullptr, 10) : 10;
+        size_t max_power = argc > 3 ? strtoul(argv[3], nullptr, 10) : 22;
+        WavProcessor::benchmarkFFT(min_power, max_power);
+        return 0;
+    }
+
+    // -k kind - вариант FFT для сжатия (radix-2, radix-4, radix-8, split-radix или measure), по умолчанию radix-4
+    FFTPlan::Kind kind = FFTPlan::Kind::radix4;
+    if (argc > 2 && strcmp(argv[1], "-k") == 0) {
+        if (!FFTPlan::kindByName(argv[2], kind)) {
+            std::cerr << "Unknown FFT kind: " << argv[2] << std::endl;
+            return 1;
+        }
+        argv += 2;
+        argc -= 2;
+    }
+
     std::string input_filename, output_filename;
     if (argc < 3) {
         while(std::cout << "Enter .wav filename: ", std::cin >> input_filename) {
@@ -393,7 +1048,7 @@ int main(int argc, char** argv) {
             std::cout << "Enter rate: ";
             std::cin >> rate;
             output_filename = OUT_PREFIX + input_filename;
-            createAndCompress(input_filename, output_filename, rate);
+            createAndCompress(input_filename, output_filename, rate, kind);
         }
     }
     else {
@@ -403,7 +1058,7 @@ int main(int argc, char** argv) {
             input_filename = argv[i];
             std::cout << " file: " << input_filename << std::endl;
             output_filename = OUT_PREFIX + input_filename;
-            createAndCompress(input_filename, output_filename, rate);
+            createAndCompress(input_filename, output_filename, rate, kind);
         }
     }
 